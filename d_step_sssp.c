@@ -9,333 +9,929 @@
 //
 // -------------------------------------------------------
 
+#define _GNU_SOURCE // Threads affinity.
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#ifdef USE_NUMA
+#include <numa.h>
+#endif
+
+#include "dstep.h"
+
+// Engine state structure, holding the per source node state of the
+// selected engine, which shares its read-only Graph.
+struct engine_state {
+    struct dstep_radix_engine radix; // Radix engine state.
+    struct dstep_dense_engine dense; // Dense engine state.
+    struct dstep_context solver;     // Buckets and batched engines state.
+};
+
+// Task structure, a source node to find distances from and its estimated cost.
+// Batched engine tasks are the first source node of each batch.
+struct task {
+    index_t source;  // Source node.
+    double cost;     // Estimated cost.
+};
+
+// Task deque structure, owned by a worker. The owner takes tasks from the
+// head, where the most expensive ones are, and thieves from the tail.
+struct task_deque {
+    index_t *sources;      // Tasks source nodes, by decreasing cost.
+    index_t head;          // First remaining task.
+    index_t tail;          // End of remaining tasks.
+    pthread_mutex_t lock;  // Lock guarding head and tail.
+};
+
+// Worker structure, a thread with its tasks and its own engine state,
+// sharing the read-only Graph of the selected engine.
+struct worker {
+    pthread_t thread;          // Worker thread.
+    index_t id;                // Worker index.
+    struct task_deque deque;   // Owned tasks.
+    struct engine_state state; // Engine state.
+    index_t stolen;            // Tasks stolen from other workers.
+    int cpu;                   // Processor the worker is pinned to, -1 if not pinned.
+};
+
+// Graph replica structure, a copy of the selected engine read-only Graph
+// placed on a NUMA node, or interleaved across all of them.
+struct graph_replica {
+    struct dstep_radix_graph radix; // Radix engine Graph copy.
+    struct dstep_dense_graph dense; // Dense engine Graph copy.
+    struct dstep_graph graph;       // Compressed rows Graph copy, used by the buckets and batched engines.
+    int ready;                      // Copy is made.
+    pthread_mutex_t lock;           // Lock guarding the copy.
+};
+
+// Checkpoint file identifier, written first, followed by the index and weight
+// types sizes and the nodes count. Each next record is a completed source node
+// and its distances row, in original ids.
+#define CHECKPOINT_MAGIC "DSTEPCK1"
+
+// Engines used for finding the shortest path distances.
+enum engine {
+    ENGINE_AUTO,    // Dense engine for dense Graphs, buckets engine otherwise.
+    ENGINE_BUCKETS, // Original D-Stepping buckets.
+    ENGINE_RADIX,   // Integer weights, power of two D radix buckets.
+    ENGINE_DENSE,   // SIMD min-plus rows over a padded matrix.
+    ENGINE_BATCHED  // BATCH_SIZE sources per Graph traversal.
+};
 
-// Bucket structure
-struct bucket {
-    int *delta;
-    int *nodes;
+// Worker threads pinnings.
+enum pin {
+    PIN_NONE,     // Threads are scheduled by the operating system.
+    PIN_COMPACT,  // Workers are pinned to consecutive allowed processors.
+    PIN_SCATTER   // Workers are spread evenly over allowed processors.
+};
+
+// Worker threads Graph placements on NUMA nodes.
+enum numa_policy {
+    NUMA_NONE,       // Graph stays where it was initialized.
+    NUMA_INTERLEAVE, // Graph is copied once, its pages interleaved across nodes.
+    NUMA_REPLICATE   // Graph is copied on each node running workers.
+};
+
+// Nodes reorderings applied before finding distances.
+enum reorder {
+    REORDER_NONE,   // Nodes ids are used as-is.
+    REORDER_RCM,    // Reverse Cuthill-McKee ordering.
+    REORDER_DEGREE  // Descending degree ordering.
 };
 
 double d_step;          // D value used.
 FILE *fin;              // Input file.
 FILE *fout;             // Output file.
-int nodes_count;        // Graph nodes count.
-double **matrix;        // Graph nodes matrix.
-struct bucket *buckets; // Buckets array.
-double **distances;     // Shortest path distance from each node to all other nodes.
-int *light_nodes;       // Light nodes array.
-int *heavy_nodes;       // Heavy nodes array.
-int *visited_nodes;     // Visited nodes array, used to prevent loops.
-int *updated_nodes;     // Updated nodes array, used to also update visited neighbors.
-int source_node;        // Source node to find distances.
-
-// This function inserts a given value at the end of a given array.
+FILE *fprevious;        // Previous distances file, used in update mode.
+FILE *fchanges;         // Edge changes file, used in update mode.
+index_t nodes_count;    // Graph nodes count.
+weight_t **distances;   // Shortest path distance from each node to all other nodes.
+enum engine engine;     // Engine used.
+
+struct dstep_graph graph;                       // Graph compressed rows, read from the input file.
+struct engine_state engine_state;               // Engine state of the main thread.
+struct dstep_radix_graph radix_graph;           // Radix engine Graph.
+struct dstep_dense_graph dense_graph;           // Dense engine Graph.
+double scale;                                   // Weights quantization scale, used by the radix engine, 0 to find it from the weights.
+double dense_threshold = 0.25;                  // Edge density selecting the dense engine automatically.
+enum dstep_strategy strategy;                   // Bucket strategy of the buckets, batched and symmetric engines.
+index_t rho = 4;                                // Lightest edges rank used as node radius by the radius strategy.
+int symmetric;                                  // Undirected APSP mode, storing the upper triangle only.
+struct dstep_symmetric_engine symmetric_engine; // Symmetric engine, used in symmetric mode.
+index_t threads_count = 1;                      // Worker threads count, finding distances of different sources.
+struct worker *workers;                         // Workers, used when threads count is greater than 1.
+enum pin pin;                                   // Worker threads pinning.
+enum numa_policy numa_policy;                   // Worker threads Graph placement.
+index_t writers_count;                          // Output formatting threads, 0 for one per online processor.
+struct graph_replica *replicas;                 // Graph replicas, one per NUMA node or a single interleaved one.
+int replicas_count;                             // Graph replicas count.
+char *checkpoint_filename;                      // Checkpoint file name, NULL if unused.
+FILE *fcheckpoint;                              // Checkpoint file.
+double checkpoint_interval = 60;                // Seconds between checkpoint file syncs.
+int resume;                                     // Resume from the checkpoint file completed sources.
+char *completed;                                // Completed source nodes marks, used with checkpoints.
+weight_t *checkpoint_row;                       // Distances row in original ids, being written.
+struct timespec last_checkpoint;                // Last checkpoint file sync time.
+pthread_mutex_t checkpoint_lock;                // Lock guarding the checkpoint file.
+struct dstep_edge_change *changes;              // Edge changes, used in update mode.
+index_t changes_count;                          // Edge changes count.
+int server;                                     // Server mode, answering queries from standard input.
+double cache_mb = 64;                           // Row cache memory budget in MB, used in server mode.
+struct dstep_row_cache row_cache;               // Row cache, used in server mode.
+struct dstep_pair_engine pair_engine;           // Point-to-point engine, used in server and bounded modes.
+int bidirectional;                              // Point-to-point queries search from both ends.
+index_t pair_source = -1;                       // Pair mode source node, -1 if unused.
+index_t pair_target = -1;                       // Pair mode target node.
+size_t pair_queries;                            // Point-to-point queries answered without a row.
+double radius = -1;                             // Bounded mode radius, negative if unused.
+index_t nearest;                                // Bounded mode nearest nodes count, 0 if unused.
+size_t *bounded_offsets;                        // First result of each source node, nodes count + 1 entries.
+struct dstep_bounded_result *bounded_results;   // Bounded mode results, sorted by distance per source node.
+size_t bounded_capacity;                        // Allocated results count.
+enum reorder reorder;                           // Nodes reordering used.
+index_t *new_ids;                               // Reordered id of each original node, NULL when not reordered.
+index_t *old_ids;                               // Original id of each reordered node.
+
+// This function allocates memory, terminating the program on failure.
+// Inputs:
+//      size_t size: Bytes to allocate.
+//      char *name: Allocation name, used in error message.
+// Output:
+//      void * --> Allocated memory.
+void *allocate_memory(size_t size, char *name)
+{
+    void *ptr = malloc(size);
+    if (ptr == NULL) {
+        printf("Error: malloc for %s failed.\n", name);
+        exit(1);
+    }
+    return ptr;
+}
+
+// This function labels the Graph connected components, so engines only
+// search the source node component. If nodes were reordered, components
+// are labelled in new ids.
+void label_components()
+{
+    index_t largest = 0;
+
+    if (!dstep_graph_components(&graph)) {
+        printf("Error: malloc for components failed.\n");
+        exit(1);
+    }
+    for (index_t i = 0; i < graph.components_count; i++) {
+        if (graph.component_offsets[i + 1] - graph.component_offsets[i] > largest) {
+            largest = graph.component_offsets[i + 1] - graph.component_offsets[i];
+        }
+    }
+    printf("Connected components: " INDEX_FORMAT ", largest: " INDEX_FORMAT " nodes\n", graph.components_count, largest);
+}
+
+// This function initializes the Graph, by reading the input file into
+// compressed rows.
+// Output:
+//      1 --> Graph read succussfully.
+//      0 --> Something went wrong.
+int initialize_graph()
+{
+    if (!dstep_graph_read(&graph, fin)) {
+        printf("Error: cannot read Graph from input file.\n");
+        return 0;
+    }
+    nodes_count = graph.nodes_count;
+    return 1;
+}
+
+// This function initializes the distances matrix.
+// Rows are prefilled with NO_WEIGHT, as engines only store the distances
+// of the source node component. With worker threads rows are filled
+// by the workers finding them.
+void initialize_distances()
+{
+    distances = (weight_t**)malloc(sizeof(weight_t*) * nodes_count + sizeof(weight_t) * nodes_count * nodes_count);
+    if (distances == NULL) {
+        printf("Error: malloc for distances failed.\n");
+        exit(1);
+    }
+    weight_t *ptr = (weight_t*)(distances + nodes_count);
+    for (index_t i = 0; i < nodes_count; i++) {
+        distances[i] = (ptr + (size_t)nodes_count * i);
+        if (threads_count > 1) {
+            continue;
+        }
+        for (index_t j = 0; j < nodes_count; j++) {
+            distances[i][j] = NO_WEIGHT;            
+        }        
+    }
+}
+
+// This function relabels Graph nodes for locality, using the selected
+// reordering, and permutes the Graph accordingly. Distances are
+// found on the permuted Graph and mapped back to original ids when
+// written to the output file.
+void reorder_graph()
+{
+    if (reorder == REORDER_NONE) {
+        return;
+    }
+    old_ids = (index_t*)allocate_memory(nodes_count * sizeof(index_t), "old_ids");
+    new_ids = (index_t*)allocate_memory(nodes_count * sizeof(index_t), "new_ids");
+    if (!dstep_graph_reorder(&graph, reorder == REORDER_RCM ? DSTEP_ORDERING_RCM : DSTEP_ORDERING_DEGREE, new_ids, old_ids)) {
+        printf("Error: malloc for permuted graph failed.\n");
+        exit(1);
+    }
+}
+
+// This function checks the radix engine scale, finding the lowest power
+// of ten making all weights and D integers when it isn't given. Rounding scaled
+// weights would silently change distances, so such runs are rejected, as
+// are scales making D smaller than one.
+void check_radix_scale()
+{
+    double found = dstep_radix_scale(&graph, d_step, scale);
+
+    if (found == 0 && scale == 0) {
+        printf("Error: no power of ten up to 1e%d makes all weights and D integers, radix engine requires --scale.\n", DSTEP_RADIX_DIGITS);
+        exit(1);
+    } else if (found == 0 && (dstep_radix_t)(d_step * scale) == 0) {
+        printf("Error: D-step times scale %lf is below 1, radix engine requires a larger scale or D-step.\n", scale);
+        exit(1);
+    } else if (found == 0) {
+        printf("Error: weights times scale %lf are not all integers, radix engine would round them.\n", scale);
+        exit(1);
+    }
+    scale = found;
+    printf("Radix engine weights scale: %lf\n", scale);
+}
+
+// This function initializes an engine state for the selected engine.
 // Inputs:
-//      int *array: The array.
-//      int node: The value to insert.
-void push_node(int *array, int node)
+//      struct engine_state *state: The engine state.
+//      struct dstep_radix_graph *radix: The radix engine Graph used.
+//      struct dstep_dense_graph *dense: The dense engine Graph used.
+//      struct dstep_graph *compressed: The compressed rows Graph used.
+void initialize_engine_state(struct engine_state *state, struct dstep_radix_graph *radix, struct dstep_dense_graph *dense, struct dstep_graph *compressed)
 {
-    int pos = 0;    
-    int item = array[0];    
-    while (item != node && item != -1) {
-        pos ++;
-        item = array[pos];        
+    int done;
+
+    if (engine == ENGINE_RADIX) {
+        done = dstep_radix_initialize(&state->radix, radix);
+    } else if (engine == ENGINE_DENSE) {
+        done = dstep_dense_initialize(&state->dense, dense, d_step);
+    } else {
+        done = dstep_context_initialize(&state->solver, compressed, d_step) && dstep_context_strategy(&state->solver, strategy, rho);
+    }
+    if (!done) {
+        printf("Error: malloc for engine state failed.\n");
+        exit(1);
     }
-    array[pos] = node;
 }
 
-// This function removes all values of a given array.
+// This function frees allocated memory of an engine state.
 // Inputs:
-//      int *array: The array.
-void empty_array(int *array)
+//      struct engine_state *state: The engine state.
+void free_engine_state(struct engine_state *state)
 {
-    int pos = 0;    
-    int item = array[pos];    
-    while (item != -1) {
-        array[pos] = -1;
-        pos ++;
-        item = array[pos];        
-    }    
+    if (engine == ENGINE_RADIX) {
+        dstep_radix_free(&state->radix);
+    } else if (engine == ENGINE_DENSE) {
+        dstep_dense_free(&state->dense);
+    } else {
+        dstep_context_free(&state->solver);
+    }
 }
 
-// This function checks if a given array contains a given value.
+// This function appends the bounded results of a source node to the
+// bounded results of all source nodes, which are found in ids order.
 // Inputs:
-//      int *array: The array.
-//      int node: The value to check.
-// Output:
-//      1 --> The array contains the value.
-//      0 --> The array doesn't contains the value.
-int contains(int *array, int node)
+//      index_t source: The source node.
+//      index_t count: Results count, stored in the point-to-point engine.
+void append_bounded_results(index_t source, index_t count)
 {
-    int pos = 0;    
-    int item = array[pos];    
-    while (item != node && item != -1) {
-        pos ++;
-        item = array[pos];        
+    size_t first = bounded_offsets[source];
+
+    if (bounded_capacity < first + count) {
+        bounded_capacity = 2 * bounded_capacity + count;
+        bounded_results = (struct dstep_bounded_result*)realloc(bounded_results, bounded_capacity * sizeof(struct dstep_bounded_result));
+        if (bounded_results == NULL) {
+            printf("Error: realloc for bounded_results failed.\n");
+            exit(1);
+        }
     }
-    return array[pos] == node;
+    memcpy(bounded_results + first, pair_engine.results, count * sizeof(struct dstep_bounded_result));
+    bounded_offsets[source + 1] = first + count;
 }
 
-// This functions cleanses all empty buckets so they can be used again. 
-// Also it will return the first non empty bucket or the last one,
-// in case all are empty.
-// Output:
-//      struct bucket --> Returned bucket.
-struct bucket find_next_bucket()
+// This function resolves the automatic engine selection, using the
+// Graph edge density: dense Graphs use the dense engine, rest the
+// D-Stepping buckets engine, which a bucket strategy also requires.
+void select_engine()
 {
-    for (int i = 0; i < nodes_count; i++) {
-        if (buckets[i].nodes[0] == -1) {
-            buckets[i].delta[0] = -1;        
-        }    
+    if (engine != ENGINE_AUTO) {
+        return;
     }
-    int pos = 0;
-    struct bucket item = buckets[pos];
-    while (item.delta[0] == -1 && pos + 1 < nodes_count) {
-        pos ++;
-        item = buckets[pos];    
+    size_t edges = graph.offsets[nodes_count];
+    double density = nodes_count > 1 ? (double)edges / ((double)nodes_count * (nodes_count - 1)) : 0.0;
+    if (density >= dense_threshold && strategy == DSTEP_STRATEGY_FIXED) {
+        engine = ENGINE_DENSE;
+        printf("Edge density %lf, using dense engine.\n", density);
+    } else {
+        engine = ENGINE_BUCKETS;
+    }
+}
+
+// This function finds the shortest path distances from a source node
+// to all other nodes, using the selected engine.
+// Inputs:
+//      struct engine_state *state: The engine state.
+//      index_t source: The source node, first of its batch for the batched engine.
+//      weight_t *row: Distances row to store found distances, prefilled with NO_WEIGHT.
+void find_row(struct engine_state *state, index_t source, weight_t *row)
+{
+    if (engine == ENGINE_BATCHED) {
+        index_t count = nodes_count - source < BATCH_SIZE ? nodes_count - source : BATCH_SIZE;
+        dstep_apsp(&state->solver, source, count, distances + source);
+    } else if (dstep_component_size(&graph, source) == 1) {
+        // Isolated node, its row is empty without computation.
+    } else if (engine == ENGINE_RADIX) {
+        dstep_radix_sssp(&state->radix, source, row);
+    } else if (engine == ENGINE_DENSE) {
+        dstep_dense_sssp(&state->dense, source, row);
+    } else {
+        dstep_sssp(&state->solver, source, row);
+    }
+}
+
+// This function finds the shortest path distances from a source node
+// to all other nodes, or its bounded results, in the selected mode.
+// Inputs:
+//      index_t source: The source node.
+void find_distances(index_t source)
+{
+    if (radius >= 0 || nearest > 0) {
+        index_t count = 0;
+        if (dstep_component_size(&graph, source) > 1) {
+            count = dstep_bounded_search(&pair_engine, source, radius, nearest);
+        }
+        append_bounded_results(source, count);
+    } else if (symmetric) {
+        dstep_symmetric_sssp(&symmetric_engine, source);
+    } else if (engine != ENGINE_BATCHED || source % BATCH_SIZE == 0) {
+        // Batched engine finds distances of the whole batch on its first source.
+        find_row(&engine_state, source, distances[source]);
+    }
+}
+
+// This function opens the checkpoint file. When resuming, rows of completed
+// source nodes are read back and a truncated last record is discarded, so new
+// records follow the last complete one. Otherwise, a new file is started.
+void open_checkpoint()
+{
+    char magic[8];
+    uint32_t sizes[2] = { sizeof(index_t), sizeof(weight_t) };
+    uint32_t file_sizes[2];
+    index_t count, source, resumed = 0;
+    long header = sizeof(magic) + sizeof(sizes) + sizeof(index_t);
+    long record = sizeof(index_t) + sizeof(weight_t) * nodes_count;
+
+    pthread_mutex_init(&checkpoint_lock, NULL);
+    completed = (char*)allocate_memory(nodes_count * sizeof(char), "completed");
+    checkpoint_row = (weight_t*)allocate_memory(nodes_count * sizeof(weight_t), "checkpoint row");
+    for (index_t i = 0; i < nodes_count; i++) {
+        completed[i] = 0;
+    }
+    fcheckpoint = resume ? fopen(checkpoint_filename, "r+b") : NULL;
+    if (fcheckpoint != NULL) {
+        if (fread(magic, sizeof(magic), 1, fcheckpoint) != 1 || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+            || fread(file_sizes, sizeof(file_sizes), 1, fcheckpoint) != 1 || file_sizes[0] != sizes[0] || file_sizes[1] != sizes[1]
+            || fread(&count, sizeof(index_t), 1, fcheckpoint) != 1 || count != nodes_count) {
+            printf("Error: checkpoint file %s doesn't match the Graph or the compiled types.\n", checkpoint_filename);
+            exit(1);
+        }
+        long end = header;
+        while (fread(&source, sizeof(index_t), 1, fcheckpoint) == 1
+            && source >= 0 && source < nodes_count
+            && fread(checkpoint_row, sizeof(weight_t), nodes_count, fcheckpoint) == (size_t)nodes_count) {
+            index_t node = new_ids == NULL ? source : new_ids[source];
+            for (index_t j = 0; j < nodes_count; j++) {
+                distances[node][new_ids == NULL ? j : new_ids[j]] = checkpoint_row[j];
+            }
+            if (!completed[node]) {
+                completed[node] = 1;
+                resumed ++;
+            }
+            end += record;
+        }
+        if (fseek(fcheckpoint, end, SEEK_SET) != 0 || ftruncate(fileno(fcheckpoint), end) != 0) {
+            printf("Error: cannot truncate checkpoint file %s.\n", checkpoint_filename);
+            exit(1);
+        }
+        printf("Resumed " INDEX_FORMAT " completed sources from checkpoint file %s.\n", resumed, checkpoint_filename);
+    } else {
+        fcheckpoint = fopen(checkpoint_filename, "wb");
+        if (fcheckpoint == NULL) {
+            printf("Error: cannot open checkpoint file %s.\n", checkpoint_filename);
+            exit(1);
+        }
+        fwrite(CHECKPOINT_MAGIC, sizeof(magic), 1, fcheckpoint);
+        fwrite(sizes, sizeof(sizes), 1, fcheckpoint);
+        fwrite(&nodes_count, sizeof(index_t), 1, fcheckpoint);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &last_checkpoint);
+}
+
+// This function syncs the checkpoint file to disk.
+void sync_checkpoint()
+{
+    fflush(fcheckpoint);
+    fsync(fileno(fcheckpoint));
+    clock_gettime(CLOCK_MONOTONIC, &last_checkpoint);
+}
+
+// This function closes the checkpoint file, syncing all its records.
+void close_checkpoint()
+{
+    if (fcheckpoint == NULL) {
+        return;
     }
-    return item;
+    sync_checkpoint();
+    fclose(fcheckpoint);
+    fcheckpoint = NULL;
 }
 
-// This functions retrieves the bucket for a given D value.
-// If the bucket doesn't exists, it assigns it to a cleansed one.
+// This function returns whether the distances from a source node are
+// already found, read from the checkpoint file. For the batched engine,
+// the whole batch of its first source node must be found.
 // Inputs:
-//      int d: The D value to search.
+//      index_t source: The source node.
 // Output:
-//      struct bucket --> Returned bucket.
-struct bucket retrieve_bucket(int d)
+//      1 --> The distances are found.
+//      0 --> The distances must be found.
+int source_completed(index_t source)
 {
-    struct bucket b;
-    b.delta = (int*)malloc(sizeof(int));
-    if (b.delta == NULL) {
-        printf("Error: malloc for b.delta failed.\n");
-        exit(1);
+    if (completed == NULL) {
+        return 0;
     }
-    b.delta[0] = -1;
-    for (int i= 0; i < nodes_count; i++) {
-        if (buckets[i].delta[0] == d) {
-            b = buckets[i];    
-            break;    
-        }    
+    if (engine != ENGINE_BATCHED) {
+        return completed[source];
     }
-    if (b.delta[0] != d) {
-        int pos = 0;
-        b = buckets[0];
-        while (b.delta[0] != -1) {
-            pos ++;
-            b = buckets[pos];    
+    source -= source % BATCH_SIZE;
+    for (index_t i = source; i < source + BATCH_SIZE && i < nodes_count; i++) {
+        if (!completed[i]) {
+            return 0;
         }
-        b.delta[0] = d;        
     }
-    return b;
+    return 1;
 }
 
-// This functions add nodes contained in a given bucket to the 
-// Visited nodes array and relaxes(insert to appropriate bucket) nodes 
-// contained in a given array.
+// This function appends the distances rows found from a source node to the
+// checkpoint file, all rows of the batch for the batched engine first source
+// node, and syncs the file when the checkpoint interval has passed.
 // Inputs:
-//      int *bucket_nodes: The bucket.
-//      int *relax_nodes: The array to relax.
-void relax_nodes(int *bucket_nodes, int *relax_nodes)
-{
-    int pos = 0;    
-    int item = bucket_nodes[0];
-
-    // Add buckets nodes to Visited nodes array in order to prevent loops.
-    while (item != -1) {        
-        push_node(visited_nodes, item);
-        pos ++;
-        item = bucket_nodes[pos];
-    }
-    empty_array(bucket_nodes);
-    
-    struct bucket node_bucket;
-    int node_delta;
-    pos = 0;    
-    item = relax_nodes[0];    
-    while (item != -1) {
-        node_delta = distances[source_node][item] / d_step; // Find node Delta value.
-        node_bucket = retrieve_bucket(node_delta); // Retrieve bucket for that Delta value.    
-        if (!contains(visited_nodes, item)) { // Prevent loops.
-            push_node(node_bucket.nodes, item);
-        }    
-        pos ++;
-        item = relax_nodes[pos];    
-    }
-    pos = 0;    
-    item = updated_nodes[0];    
-    while (item != -1) { 
-        node_delta = distances[source_node][item] / d_step; 
-        node_bucket = retrieve_bucket(node_delta);        
-        push_node(node_bucket.nodes, item); // Insert updated nodes in order to revisit neighbors.
-        pos ++;
-        item = updated_nodes[pos];
-    }
-    empty_array(updated_nodes);    
-}
-
-// This function resets arrays used by the program.
-void reset_node_structures()
-{
-    for (int i = 0; i < nodes_count; i++) {
-        heavy_nodes[i] = -1;
-        light_nodes[i] = -1;
-        visited_nodes[i] = -1;
-        updated_nodes[i] = -1;
-    }
-}
-
-// This function initializes the Graph matrix, by reading the input file.
-void initialize_matrix()
-{
-    int i, j;
-    double w;
+//      index_t source: The source node.
+void checkpoint_source(index_t source)
+{
+    struct timespec now;
+    index_t last = source + 1;
 
-    matrix = (double**)malloc(sizeof(double*) * nodes_count + sizeof(double) * nodes_count * nodes_count);
-    if (matrix == NULL) {
-        printf("Error: malloc for matrix failed.\n");
-        exit(1);
+    if (fcheckpoint == NULL) {
+        return;
     }
-    double *ptr = (double*)(matrix + nodes_count);
-    for(i = 0; i < nodes_count; i++) {
-        matrix[i] = (ptr + nodes_count * i);
-        for (j = 0; j < nodes_count; j++) {
-            matrix[i][j] = -1;            
+    if (engine == ENGINE_BATCHED) {
+        if (source % BATCH_SIZE != 0) {
+            return;
         }
-    }            
-    fscanf(fin, "%d", &i);
-    while (i != -1) {
-        fscanf(fin, "%d %lf \n", &j, &w);
-        if (i != j && (matrix[i][j] == -1 || w < matrix[i][j])) {
-            matrix[i][j] = w;
-            matrix[j][i] = w;
-        }                
-        fscanf(fin, "%d", &i);
-    }            
+        last = source + BATCH_SIZE < nodes_count ? source + BATCH_SIZE : nodes_count;
+    }
+    pthread_mutex_lock(&checkpoint_lock);
+    for (index_t node = source; node < last; node++) {
+        index_t original = old_ids == NULL ? node : old_ids[node];
+        for (index_t j = 0; j < nodes_count; j++) {
+            checkpoint_row[j] = distances[node][new_ids == NULL ? j : new_ids[j]];
+        }
+        fwrite(&original, sizeof(index_t), 1, fcheckpoint);
+        fwrite(checkpoint_row, sizeof(weight_t), nodes_count, fcheckpoint);
+        completed[node] = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - last_checkpoint.tv_sec) + (now.tv_nsec - last_checkpoint.tv_nsec) / 1e9 >= checkpoint_interval) {
+        sync_checkpoint();
+    }
+    pthread_mutex_unlock(&checkpoint_lock);
 }
 
-// This function initializes all arrays used by the program.
-void initialize_structures()
+// This function estimates the cost of finding the distances from a source
+// node, as its component nodes and edges counts: every node is settled and
+// its out edges relaxed. For the batched engine, costs of all batch sources
+// are added.
+// Inputs:
+//      index_t source: The source node, first of its batch for the batched engine.
+// Output:
+//      double --> The estimated cost.
+double task_cost(index_t source)
 {
-    buckets = (struct bucket*)malloc(nodes_count * sizeof( struct bucket));
-    if (buckets == NULL) {
-        printf("Error: malloc for buckets failed.\n");
-        exit(1);
+    double cost = 0;
+    index_t last = engine == ENGINE_BATCHED ? source + BATCH_SIZE : source + 1;
+    for (index_t i = source; i < last && i < nodes_count; i++) {
+        cost += dstep_search_cost(&graph, i);
     }
-    distances = (double**)malloc(sizeof(double*) * nodes_count + sizeof(double) * nodes_count * nodes_count);
-    if (distances == NULL) {
-        printf("Error: malloc for distances failed.\n");
-        exit(1);
+    return cost;
+}
+
+// This function compares tasks by decreasing cost, then source node.
+// Inputs:
+//      const void *a: First task.
+//      const void *b: Second task.
+// Output:
+//      int --> Negative, zero or positive as a runs before, with or after b.
+int compare_tasks(const void *a, const void *b)
+{
+    const struct task *x = (const struct task*)a;
+    const struct task *y = (const struct task*)b;
+    if (x->cost != y->cost) {
+        return x->cost > y->cost ? -1 : 1;
     }
-    double *ptr = (double*)(distances + nodes_count);
-    heavy_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (heavy_nodes == NULL) {
-        printf("Error: malloc for heavy_nodes failed.\n");
-        exit(1);
+    return (x->source > y->source) - (x->source < y->source);
+}
+
+// This function pins the calling worker thread to one processor of the
+// process allowed ones, consecutive ones for compact pinning, or evenly
+// spread ones for scatter pinning, so workers cover all sockets.
+// Inputs:
+//      struct worker *worker: The worker.
+void pin_worker(struct worker *worker)
+{
+    cpu_set_t allowed, set;
+    int count, target, cpu;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
     }
-    light_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (light_nodes == NULL) {
-        printf("Error: malloc for light_nodes failed.\n");
-        exit(1);
+    count = CPU_COUNT(&allowed);
+    if (pin == PIN_SCATTER && threads_count < count) {
+        target = (int)((long long)worker->id * count / threads_count);
+    } else {
+        target = worker->id % count;
     }
-    visited_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (visited_nodes == NULL) {
-        printf("Error: malloc for visited_nodes failed.\n");
-        exit(1);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            break;
+        }
     }
-    updated_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (updated_nodes == NULL) {
-        printf("Error: malloc for updated_nodes failed.\n");
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        worker->cpu = cpu;
+    }
+}
+
+#ifdef USE_NUMA
+// This function returns a NUMA allocation size, at least one byte.
+// Inputs:
+//      size_t size: The requested size.
+// Output:
+//      size_t --> The allocation size.
+size_t numa_size(size_t size)
+{
+    return size == 0 ? 1 : size;
+}
+
+// This function copies memory on a NUMA node, or interleaved across all nodes.
+// Inputs:
+//      void *source: The memory to copy.
+//      size_t size: The memory size.
+//      int node: The NUMA node, -1 to interleave.
+// Output:
+//      void * --> The copy.
+void *numa_copy(void *source, size_t size, int node)
+{
+    void *copy = node < 0 ? numa_alloc_interleaved(numa_size(size)) : numa_alloc_onnode(numa_size(size), node);
+    if (copy == NULL) {
+        printf("Error: NUMA allocation for Graph replica failed.\n");
         exit(1);
     }
-    for (int i = 0; i < nodes_count; i++) {
-        buckets[i].delta = (int*)malloc(sizeof(int));
-        if (buckets[i].delta == NULL) {
-            printf("Error: malloc for buckets[%d].delta failed.\n", i);
-            exit(1);
+    memcpy(copy, source, size);
+    return copy;
+}
+
+// This function copies the selected engine Graph to a replica.
+// Inputs:
+//      struct graph_replica *replica: The replica.
+//      int node: The NUMA node, -1 to interleave.
+void make_replica(struct graph_replica *replica, int node)
+{
+    size_t n = nodes_count;
+
+    if (engine == ENGINE_RADIX) {
+        size_t edges = radix_graph.offsets[nodes_count];
+        replica->radix = radix_graph;
+        replica->radix.offsets = (index_t*)numa_copy(radix_graph.offsets, (n + 1) * sizeof(index_t), node);
+        replica->radix.light_ends = (index_t*)numa_copy(radix_graph.light_ends, n * sizeof(index_t), node);
+        replica->radix.targets = (index_t*)numa_copy(radix_graph.targets, edges * sizeof(index_t), node);
+        replica->radix.weights = (dstep_radix_t*)numa_copy(radix_graph.weights, edges * sizeof(dstep_radix_t), node);
+    } else if (engine == ENGINE_DENSE) {
+        replica->dense = dense_graph;
+        replica->dense.weights = (weight_t*)numa_copy(dense_graph.weights, sizeof(weight_t) * dense_graph.stride * n, node);
+    } else {
+        size_t edges = graph.offsets[nodes_count];
+        replica->graph = graph;
+        replica->graph.offsets = (index_t*)numa_copy(graph.offsets, (n + 1) * sizeof(index_t), node);
+        replica->graph.targets = (index_t*)numa_copy(graph.targets, edges * sizeof(index_t), node);
+        replica->graph.weights = (weight_t*)numa_copy(graph.weights, edges * sizeof(weight_t), node);
+    }
+    replica->ready = 1;
+}
+
+// This function frees a replica copies.
+// Inputs:
+//      struct graph_replica *replica: The replica.
+void free_replica(struct graph_replica *replica)
+{
+    size_t n = nodes_count;
+
+    if (!replica->ready) {
+        return;
+    }
+    if (engine == ENGINE_RADIX) {
+        size_t edges = radix_graph.offsets[nodes_count];
+        numa_free(replica->radix.offsets, numa_size((n + 1) * sizeof(index_t)));
+        numa_free(replica->radix.light_ends, numa_size(n * sizeof(index_t)));
+        numa_free(replica->radix.targets, numa_size(edges * sizeof(index_t)));
+        numa_free(replica->radix.weights, numa_size(edges * sizeof(dstep_radix_t)));
+    } else if (engine == ENGINE_DENSE) {
+        numa_free(replica->dense.weights, numa_size(sizeof(weight_t) * dense_graph.stride * n));
+    } else {
+        size_t edges = graph.offsets[nodes_count];
+        numa_free(replica->graph.offsets, numa_size((n + 1) * sizeof(index_t)));
+        numa_free(replica->graph.targets, numa_size(edges * sizeof(index_t)));
+        numa_free(replica->graph.weights, numa_size(edges * sizeof(weight_t)));
+    }
+}
+
+// This function initializes the Graph replicas of the NUMA policy: the
+// interleaved one is made at once, per node ones by their first worker.
+void initialize_replicas()
+{
+    if (numa_policy == NUMA_NONE) {
+        return;
+    }
+    if (numa_available() < 0) {
+        printf("NUMA is not available, Graph placement is left as is.\n");
+        numa_policy = NUMA_NONE;
+        return;
+    }
+    replicas_count = numa_policy == NUMA_INTERLEAVE ? 1 : numa_max_node() + 1;
+    replicas = (struct graph_replica*)allocate_memory(replicas_count * sizeof(struct graph_replica), "replicas");
+    for (int i = 0; i < replicas_count; i++) {
+        memset(&replicas[i], 0, sizeof(struct graph_replica));
+        pthread_mutex_init(&replicas[i].lock, NULL);
+    }
+    if (numa_policy == NUMA_INTERLEAVE) {
+        make_replica(&replicas[0], -1);
+    }
+}
+
+// This function returns the Graph replica a worker uses, making the
+// replica of its NUMA node when it is the first worker there.
+// Inputs:
+//      struct worker *worker: The worker, pinned for replication.
+// Output:
+//      struct graph_replica * --> The replica, NULL if the Graph is used as is.
+struct graph_replica *worker_replica(struct worker *worker)
+{
+    if (numa_policy == NUMA_NONE) {
+        return NULL;
+    }
+    if (numa_policy == NUMA_INTERLEAVE) {
+        return &replicas[0];
+    }
+    int node = numa_node_of_cpu(worker->cpu);
+    if (node < 0 || node >= replicas_count) {
+        return NULL;
+    }
+    struct graph_replica *replica = &replicas[node];
+    pthread_mutex_lock(&replica->lock);
+    if (!replica->ready) {
+        make_replica(replica, node);
+    }
+    pthread_mutex_unlock(&replica->lock);
+    return replica;
+}
+#endif
+
+// This function initializes a worker engine state, in the worker thread, so
+// its pages are first touched, and placed, on the worker NUMA node.
+// Inputs:
+//      struct worker *worker: The worker.
+//      struct graph_replica *replica: The Graph replica to use, NULL for the Graph as is.
+void initialize_worker_engine(struct worker *worker, struct graph_replica *replica)
+{
+    if (replica != NULL) {
+        initialize_engine_state(&worker->state, &replica->radix, &replica->dense, &replica->graph);
+    } else {
+        initialize_engine_state(&worker->state, &radix_graph, &dense_graph, &graph);
+    }
+}
+
+// This function initializes the workers, each with an empty deque, large
+// enough for all tasks. Engine states are initialized by the workers threads.
+void initialize_workers()
+{
+    workers = (struct worker*)allocate_memory(threads_count * sizeof(struct worker), "workers");
+    for (index_t w = 0; w < threads_count; w++) {
+        struct worker *worker = &workers[w];
+        memset(worker, 0, sizeof(struct worker));
+        worker->id = w;
+        worker->cpu = -1;
+        worker->deque.sources = (index_t*)allocate_memory(nodes_count * sizeof(index_t), "worker deque");
+        pthread_mutex_init(&worker->deque.lock, NULL);
+    }
+#ifdef USE_NUMA
+    initialize_replicas();
+#endif
+}
+
+// This function frees allocated memory of the workers.
+void free_workers()
+{
+    if (workers == NULL) {
+        return;
+    }
+    for (index_t w = 0; w < threads_count; w++) {
+        struct worker *worker = &workers[w];
+        free(worker->deque.sources);
+        pthread_mutex_destroy(&worker->deque.lock);
+        free_engine_state(&worker->state);
+    }
+    free(workers);
+    workers = NULL;
+#ifdef USE_NUMA
+    for (int i = 0; i < replicas_count; i++) {
+        free_replica(&replicas[i]);
+        pthread_mutex_destroy(&replicas[i].lock);
+    }
+#endif
+    free(replicas);
+}
+
+// This function takes the task at the head of a worker own deque.
+// Inputs:
+//      struct worker *worker: The worker.
+// Output:
+//      index_t --> The task source node, -1 if the deque is empty.
+index_t worker_pop(struct worker *worker)
+{
+    index_t source = -1;
+    pthread_mutex_lock(&worker->deque.lock);
+    if (worker->deque.head < worker->deque.tail) {
+        source = worker->deque.sources[worker->deque.head++];
+    }
+    pthread_mutex_unlock(&worker->deque.lock);
+    return source;
+}
+
+// This function steals a task from the tail of the deque with the most
+// remaining tasks. As no tasks are created while running, finding all
+// deques empty means all tasks are taken.
+// Inputs:
+//      struct worker *thief: The idle worker.
+// Output:
+//      index_t --> The task source node, -1 if all deques are empty.
+index_t worker_steal(struct worker *thief)
+{
+    while (1) {
+        struct worker *victim = NULL;
+        index_t most = 0;
+        for (index_t k = 1; k < threads_count; k++) {
+            struct worker *worker = &workers[(thief->id + k) % threads_count];
+            pthread_mutex_lock(&worker->deque.lock);
+            index_t remaining = worker->deque.tail - worker->deque.head;
+            pthread_mutex_unlock(&worker->deque.lock);
+            if (remaining > most) {
+                most = remaining;
+                victim = worker;
+            }
         }
-        buckets[i].delta[0] = -1;
-        buckets[i].nodes = (int*)malloc(nodes_count * sizeof(int));
-        if (buckets[i].nodes == NULL) {
-            printf("Error: malloc for buckets[%d].nodes failed.\n", i);
-            exit(1);
+        if (victim == NULL) {
+            return -1;
+        }
+        // Victim may have run out of tasks since it was chosen.
+        index_t source = -1;
+        pthread_mutex_lock(&victim->deque.lock);
+        if (victim->deque.head < victim->deque.tail) {
+            source = victim->deque.sources[--victim->deque.tail];
+        }
+        pthread_mutex_unlock(&victim->deque.lock);
+        if (source != -1) {
+            thief->stolen ++;
+            return source;
         }
-        distances[i] = (ptr + nodes_count * i);
-        for (int j = 0; j < nodes_count; j++) {
-            buckets[i].nodes[j] = -1;
-            distances[i][j] = -1;            
-        }        
-        heavy_nodes[i] = -1;
-        light_nodes[i] = -1;
-        visited_nodes[i] = -1;
-        updated_nodes[i] = -1;        
     }
 }
 
-// This function frees allocated memory of all arrays used by the program.
-void free_structures()
+// This function is a worker thread body: it pins itself and initializes its
+// engine state, then finds distances from its own tasks, most expensive first,
+// then from tasks stolen from busy workers. Distances rows are filled by the
+// worker finding them, so their pages are placed on its NUMA node.
+// Inputs:
+//      void *argument: The worker.
+// Output:
+//      void * --> Always NULL.
+void *worker_run(void *argument)
 {
-    free(matrix);
-    free(buckets);
-    free(distances);
-    free(heavy_nodes);
-    free(light_nodes);
-    free(visited_nodes);
-    free(updated_nodes);
-}
-
-// This function implements the D-Stepping algorithm and finds 
-// the shortest path distances from a source node to all other nodes.
-void d_step_algorithm()
-{
-    int i, j;
-
-    // First bucket to use will contain the source node and will
-    // have Delta value 0.
-    struct bucket current_bucket = buckets[0];
-    current_bucket.delta[0] = 0;
-    push_node(current_bucket.nodes, source_node);
-
-    // While Buckets are not empty...
-    while (current_bucket.nodes[0] != -1) {                
-        i = 0;
-        while (current_bucket.nodes[i] != -1) {    // For each bucket node...        
-            for (j = 0; j < nodes_count; j++) { // For each neighbor...
-                if (matrix[current_bucket.nodes[i]][j] != -1 && j != source_node) {
-                    // Retrieve neighbor distance.
-                    double temp_distance = matrix[current_bucket.nodes[i]][j];
-                    // Insert in appropriate heavy-light node array.
-                    if (temp_distance > d_step) {
-                        push_node(heavy_nodes, j);
-                    } else {
-                        push_node(light_nodes, j);
-                    }
-                    // Add path-so-far distance for that node.
-                    if (distances[source_node][current_bucket.nodes[i]] != -1) {
-                        temp_distance += distances[source_node][current_bucket.nodes[i]];
-                    }
-                    // If the distance found is shorter that the saved one, update Distances array.                
-                    if (distances[source_node][j] == -1 || temp_distance < distances[source_node][j]) {
-                        distances[source_node][j] = temp_distance;
-                        push_node(updated_nodes, j); // Insert node to Updated nodes array.
-                    }            
-                }                    
+    struct worker *worker = (struct worker*)argument;
+    struct graph_replica *replica = NULL;
+    index_t source;
+
+    if (pin != PIN_NONE) {
+        pin_worker(worker);
+    }
+#ifdef USE_NUMA
+    replica = worker_replica(worker);
+#endif
+    initialize_worker_engine(worker, replica);
+    while ((source = worker_pop(worker)) != -1 || (source = worker_steal(worker)) != -1) {
+        index_t last = engine == ENGINE_BATCHED ? source + BATCH_SIZE : source + 1;
+        for (index_t k = source; k < last && k < nodes_count; k++) {
+            for (index_t i = 0; i < nodes_count; i++) {
+                distances[k][i] = NO_WEIGHT;
             }
-            i++;
         }
-        if (light_nodes[0] != -1) {
-            relax_nodes(current_bucket.nodes, light_nodes); // Relax Light nodes first.
-            empty_array(light_nodes);            
-        } else {
-            relax_nodes(current_bucket.nodes, heavy_nodes); // Relax Heavy nodes no light nodes exists.
-            empty_array(heavy_nodes);            
+        find_row(&worker->state, source, distances[source]);
+        checkpoint_source(source);
+    }
+    return NULL;
+}
+
+// This function finds the distances from all source nodes using the worker
+// threads. Tasks are sorted by decreasing estimated cost and dealt round robin,
+// so every deque starts with its most expensive tasks, and idle workers steal
+// from busy ones, so no worker is left alone with expensive tasks.
+void schedule_sources()
+{
+    index_t i, w, tasks_count = 0, stolen = 0;
+    index_t step = engine == ENGINE_BATCHED ? BATCH_SIZE : 1;
+    struct task *tasks = (struct task*)allocate_memory(nodes_count * sizeof(struct task), "tasks");
+
+    for (i = 0; i < nodes_count; i += step) {
+        if (source_completed(i)) {
+            continue;
         }
+        tasks[tasks_count].source = i;
+        tasks[tasks_count].cost = task_cost(i);
+        tasks_count ++;
+    }
+    qsort(tasks, tasks_count, sizeof(struct task), compare_tasks);
+    for (w = 0; w < threads_count; w++) {
+        workers[w].deque.head = 0;
+        workers[w].deque.tail = 0;
+        workers[w].stolen = 0;
+    }
+    for (i = 0; i < tasks_count; i++) {
+        struct task_deque *deque = &workers[i % threads_count].deque;
+        deque->sources[deque->tail++] = tasks[i].source;
+    }
+    free(tasks);
 
-        current_bucket = find_next_bucket(); // Retrieve next bucket to process.
+    for (w = 0; w < threads_count; w++) {
+        if (pthread_create(&workers[w].thread, NULL, worker_run, &workers[w]) != 0) {
+            printf("Error: pthread_create for worker " INDEX_FORMAT " failed.\n", w);
+            exit(1);
+        }
+    }
+    for (w = 0; w < threads_count; w++) {
+        pthread_join(workers[w].thread, NULL);
+        stolen += workers[w].stolen;
     }
+    printf("Workers: " INDEX_FORMAT ", tasks: " INDEX_FORMAT ", stolen: " INDEX_FORMAT "\n", threads_count, tasks_count, stolen);
+}
+
+// This function frees allocated memory of all arrays used by the program.
+void free_structures()
+{
+    free(distances);
+    free(new_ids);
+    free(old_ids);
+    dstep_symmetric_free(&symmetric_engine);
+    free_engine_state(&engine_state);
+    dstep_radix_graph_free(&radix_graph);
+    dstep_dense_graph_free(&dense_graph);
+    dstep_pair_free(&pair_engine);
+    dstep_row_cache_free(&row_cache);
+    dstep_graph_free(&graph);
+    free(changes);
+    free(bounded_offsets);
+    free(bounded_results);
+    free_workers();
+    free(completed);
+    free(checkpoint_row);
 }
 
 // Auxiliary function that displays a message in case of wrong input parameters.
@@ -344,21 +940,296 @@ void d_step_algorithm()
 void syntax_message(char *compiled_name)
 {
     printf("Correct syntax:\n");
-    printf("%s <d_step> <input-file> <output-file>\n", compiled_name);
+    printf("%s <d_step> <input-file> <output-file> [options]\n", compiled_name);
     printf("where: \n");
     printf("<d_step> is the desired D positive double that will be used by the algorithm.\n");
     printf("<input-file> is the file containing a generated graph by RandomGraph that the algorithm will use.\n");
     printf("<output-file> is the file shortest path distances for each node will be written.\n");
+    printf("[options] are:\n");
+    printf("--engine <auto|buckets|radix|dense|batched> selects the engine, radix requires integer or quantizable weights.\n");
+    printf("--dense-threshold <density> is the edge density above which auto selects the dense engine.\n");
+    printf("--scale <scale> multiplies weights to make them integers, used by the radix engine (default: lowest power of ten).\n");
+    printf("--reorder <none|rcm|degree> relabels nodes for locality before finding distances.\n");
+    printf("--symmetric finds undirected APSP storing and writing the upper triangle only.\n");
+    printf("--previous <distances-file> --changes <changes-file> updates a previous distances matrix after edge changes.\n");
+    printf("  Changes file contains <node> <node> <weight> lines, negative weight deletes the edge, and ends with -1.\n");
+    printf("--server answers queries read from standard input, writing answers to <output-file> (- for standard output).\n");
+    printf("--cache-mb <MB> is the memory budget of cached distances rows in server mode.\n");
+    printf("--pair <source> <target> finds only the distance between two nodes, by a point-to-point search.\n");
+    printf("--bidirectional answers pair and server distance queries searching from both nodes, for undirected graphs.\n");
+    printf("--radius <R> finds for each node only nodes within distance R, written as <node> <distance> pairs.\n");
+    printf("--threads <count> finds distances of different sources in parallel, each thread with its own engine state.\n");
+    printf("--pin <none|compact|scatter> pins worker threads to consecutive or evenly spread processors.\n");
+    printf("--numa <none|interleave|replicate> places worker threads Graph interleaved or copied on each NUMA node.\n");
+    printf("--writers <count> formats the output file in parallel threads, one per online processor by default.\n");
+    printf("--checkpoint <file> appends rows of completed sources to a binary checkpoint file.\n");
+    printf("--checkpoint-interval <seconds> is the time between checkpoint file syncs to disk.\n");
+    printf("--resume skips sources completed in the checkpoint file, reading their rows back.\n");
+    printf("--nearest <k> finds for each node only its k nearest nodes, written as <node> <distance> pairs.\n");
+    printf("--strategy <fixed|adaptive|radius> selects the buckets scanned per phase, not with radix or dense engines.\n");
+    printf("--rho <k> uses each node k-th lightest edge as its radius, with the radius strategy.\n");
+}
+
+// This function reads the optional run-time parameters,
+// following the mandatory ones.
+// Inputs:
+//      int argc: The run-time parameters count.
+//      char **argv: The run-time parameters.
+// Output:
+//      1 --> Options read succussfully.
+//      0 --> Something went wrong.
+int read_options(int argc, char **argv)
+{
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--symmetric") == 0) {
+            symmetric = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--server") == 0) {
+            server = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--bidirectional") == 0) {
+            bidirectional = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+            continue;
+        }
+        if (i + 1 == argc) {
+            printf("Option %s value missing.\n", argv[i]);
+            syntax_message(argv[0]);
+            return 0;
+        }
+        if (strcmp(argv[i], "--engine") == 0) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) {
+                engine = ENGINE_AUTO;
+            } else if (strcmp(argv[i], "buckets") == 0) {
+                engine = ENGINE_BUCKETS;
+            } else if (strcmp(argv[i], "radix") == 0) {
+                engine = ENGINE_RADIX;
+            } else if (strcmp(argv[i], "dense") == 0) {
+                engine = ENGINE_DENSE;
+            } else if (strcmp(argv[i], "batched") == 0) {
+                engine = ENGINE_BATCHED;
+            } else {
+                printf("Unknown engine %s.\n", argv[i]);
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--scale") == 0) {
+            i++;
+            scale = atof(argv[i]);
+            if (scale <= 0.0) {
+                printf("Unable to process scale.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--dense-threshold") == 0) {
+            i++;
+            dense_threshold = atof(argv[i]);
+        } else if (strcmp(argv[i], "--reorder") == 0) {
+            i++;
+            if (strcmp(argv[i], "none") == 0) {
+                reorder = REORDER_NONE;
+            } else if (strcmp(argv[i], "rcm") == 0) {
+                reorder = REORDER_RCM;
+            } else if (strcmp(argv[i], "degree") == 0) {
+                reorder = REORDER_DEGREE;
+            } else {
+                printf("Unknown reordering %s.\n", argv[i]);
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--cache-mb") == 0) {
+            i++;
+            cache_mb = atof(argv[i]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            i++;
+            threads_count = atol(argv[i]);
+            if (threads_count <= 0) {
+                printf("Unable to process threads count.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--writers") == 0) {
+            i++;
+            writers_count = atol(argv[i]);
+            if (writers_count <= 0) {
+                printf("Unable to process writers count.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            i++;
+            if (strcmp(argv[i], "none") == 0) {
+                pin = PIN_NONE;
+            } else if (strcmp(argv[i], "compact") == 0) {
+                pin = PIN_COMPACT;
+            } else if (strcmp(argv[i], "scatter") == 0) {
+                pin = PIN_SCATTER;
+            } else {
+                printf("Unknown pinning %s.\n", argv[i]);
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            i++;
+            if (strcmp(argv[i], "none") == 0) {
+                numa_policy = NUMA_NONE;
+            } else if (strcmp(argv[i], "interleave") == 0) {
+                numa_policy = NUMA_INTERLEAVE;
+            } else if (strcmp(argv[i], "replicate") == 0) {
+                numa_policy = NUMA_REPLICATE;
+            } else {
+                printf("Unknown NUMA placement %s.\n", argv[i]);
+                syntax_message(argv[0]);
+                return 0;
+            }
+#ifndef USE_NUMA
+            if (numa_policy != NUMA_NONE) {
+                printf("NUMA placement requires compiling with -DUSE_NUMA and linking with -lnuma.\n");
+                return 0;
+            }
+#endif
+        } else if (strcmp(argv[i], "--checkpoint") == 0) {
+            i++;
+            checkpoint_filename = argv[i];
+        } else if (strcmp(argv[i], "--checkpoint-interval") == 0) {
+            i++;
+            checkpoint_interval = atof(argv[i]);
+        } else if (strcmp(argv[i], "--pair") == 0) {
+            if (i + 2 == argc) {
+                printf("Option %s target node missing.\n", argv[i]);
+                syntax_message(argv[0]);
+                return 0;
+            }
+            pair_source = atol(argv[++i]);
+            pair_target = atol(argv[++i]);
+            if (pair_source < 0 || pair_target < 0) {
+                printf("Unable to process pair nodes.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--radius") == 0) {
+            i++;
+            radius = atof(argv[i]);
+            if (radius < 0.0) {
+                printf("Unable to process radius.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--nearest") == 0) {
+            i++;
+            nearest = atol(argv[i]);
+            if (nearest <= 0) {
+                printf("Unable to process nearest nodes count.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--strategy") == 0) {
+            i++;
+            if (strcmp(argv[i], "fixed") == 0) {
+                strategy = DSTEP_STRATEGY_FIXED;
+            } else if (strcmp(argv[i], "adaptive") == 0) {
+                strategy = DSTEP_STRATEGY_ADAPTIVE;
+            } else if (strcmp(argv[i], "radius") == 0) {
+                strategy = DSTEP_STRATEGY_RADIUS;
+            } else {
+                printf("Unknown bucket strategy %s.\n", argv[i]);
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--rho") == 0) {
+            i++;
+            rho = atol(argv[i]);
+            if (rho <= 0) {
+                printf("Unable to process rho.\n");
+                syntax_message(argv[0]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--previous") == 0) {
+            i++;
+            fprevious = fopen(argv[i], "r");
+            if (fprevious == NULL) {
+                printf("Cannot open previous distances file %s.\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--changes") == 0) {
+            i++;
+            fchanges = fopen(argv[i], "r");
+            if (fchanges == NULL) {
+                printf("Cannot open changes file %s.\n", argv[i]);
+                return 0;
+            }
+        } else {
+            printf("Unknown option %s.\n", argv[i]);
+            syntax_message(argv[0]);
+            return 0;
+        }
+    }
+    if ((fprevious == NULL) != (fchanges == NULL)) {
+        printf("Update mode requires both previous distances and changes files.\n");
+        syntax_message(argv[0]);
+        return 0;
+    }
+    if (fchanges != NULL && (symmetric || (engine != ENGINE_AUTO && engine != ENGINE_BUCKETS) || reorder != REORDER_NONE)) {
+        printf("Update mode doesn't support symmetric mode, reordering or engines other than buckets.\n");
+        return 0;
+    }
+    if (server && (symmetric || engine == ENGINE_BATCHED || fchanges != NULL)) {
+        printf("Server mode doesn't support symmetric mode, batched engine or update mode.\n");
+        return 0;
+    }
+    if ((radius >= 0 || nearest > 0) && (symmetric || server || fchanges != NULL)) {
+        printf("Bounded modes don't support symmetric, server or update modes.\n");
+        return 0;
+    }
+    if (pair_source >= 0 && (symmetric || server || fchanges != NULL || radius >= 0 || nearest > 0)) {
+        printf("Pair mode doesn't support symmetric, server, update or bounded modes.\n");
+        return 0;
+    }
+    if (radius >= 0 && nearest > 0) {
+        printf("Radius and nearest bounded modes can't be combined.\n");
+        return 0;
+    }
+    if (threads_count > 1 && (symmetric || server || fchanges != NULL || radius >= 0 || nearest > 0 || pair_source >= 0)) {
+        printf("Threads are supported by full distances matrix runs only.\n");
+        return 0;
+    }
+    if (resume && checkpoint_filename == NULL) {
+        printf("Resuming requires a checkpoint file.\n");
+        return 0;
+    }
+    if (checkpoint_filename != NULL && (symmetric || server || fchanges != NULL || radius >= 0 || nearest > 0 || pair_source >= 0)) {
+        printf("Checkpoints are supported by full distances matrix runs only.\n");
+        return 0;
+    }
+    if (numa_policy == NUMA_REPLICATE && pin == PIN_NONE) {
+        pin = PIN_SCATTER; // Replicas are placed by the pinned workers node.
+    }
+    if (bidirectional && !server && pair_source < 0) {
+        printf("Bidirectional search is used by pair and server modes only.\n");
+        return 0;
+    }
+    if (strategy != DSTEP_STRATEGY_FIXED && (engine == ENGINE_RADIX || engine == ENGINE_DENSE || radius >= 0 || nearest > 0 || pair_source >= 0 || fchanges != NULL)) {
+        printf("Bucket strategies are not supported by radix or dense engines, bounded or pair searches or update mode.\n");
+        return 0;
+    }
+    return 1;
 }
 
 // This function checks run-time parameters validity and
 // retrieves D-step value, input and output file names.
 // Inputs:
+//      int argc: The run-time parameters count.
 //      char **argv: The run-time parameters.
 // Output:
 //      1 --> Parameters read succussfully.
 //      0 --> Something went wrong.
-int read_parameters(char **argv)
+int read_parameters(int argc, char **argv)
 {
     char *d_step_string = argv[1];
     if (d_step_string == NULL) {
@@ -391,64 +1262,498 @@ int read_parameters(char **argv)
         return 0;
     }
             
-    fout = fopen(output_filename, "w");
+    fout = strcmp(output_filename, "-") == 0 ? stdout : fopen(output_filename, "w");
     if (fout == NULL) {
         printf("Cannot open outputfile %s.\n", output_filename);
         return 0;        
     }
+    if (!read_options(argc, argv)) {
+        return 0;
+    }
     printf("Finding shortest path distances for each node of a Graph using D-Stepping algorithm.\n");
     printf("D-Stepping value: %lf\n", d_step);
+    if (fchanges != NULL) {
+        printf("Using update mode, previous distances will be updated after edge changes.\n");
+    }
+    if (server) {
+        printf("Using server mode, rows cache budget: %lf MB\n", cache_mb);
+    }
+    if (checkpoint_filename != NULL) {
+        printf("Completed rows will be checkpointed in file %s every %lf secs.\n", checkpoint_filename, checkpoint_interval);
+    }
+    if (pair_source >= 0) {
+        printf("Using pair mode, only the distance from " INDEX_FORMAT " to " INDEX_FORMAT " will be written.\n", pair_source, pair_target);
+    }
+    if (radius >= 0) {
+        printf("Using bounded mode, nodes within radius %lf will be written.\n", radius);
+    } else if (nearest > 0) {
+        printf("Using bounded mode, " INDEX_FORMAT " nearest nodes will be written.\n", nearest);
+    }
+    if (symmetric) {
+        printf("Using symmetric mode, upper triangle will be written.\n");
+    } else if (engine == ENGINE_RADIX) {
+        printf("Using radix engine.\n");
+    }
     printf("Graph will be retrieved from input file: %s\n", input_filename);
-    printf("Distances matrix will be written in output file: %s\n", output_filename);
+    if (pair_source >= 0) {
+        printf("Distance will be written in output file: %s\n", output_filename);
+    } else {
+        printf("Distances matrix will be written in output file: %s\n", output_filename);
+    }
     return 1;
 }
 
+// This function writes the output file: the nodes count, a line per node
+// and -1 as EOF char. Lines are formatted in parallel by the library text
+// writers, each into its own buffer, and written in order.
+// Inputs:
+//      dstep_format_line format_line: Line formatter, appending a node line.
+void write_lines(dstep_format_line format_line)
+{
+    struct dstep_text text = { NULL, 0, 0, 0 };
+
+    // Lines are written past the file stream, so its pending output goes first.
+    fflush(fout);
+    dstep_text_append_node(&text, nodes_count);
+    dstep_text_append_char(&text, '\n');
+    int done = dstep_text_write(&text, fileno(fout)) &&
+               dstep_write_lines(fileno(fout), nodes_count, writers_count, (size_t)nodes_count * 10 + 1, format_line, NULL);
+    dstep_text_append_char(&text, '-');
+    dstep_text_append_char(&text, '1');
+    done = done && dstep_text_write(&text, fileno(fout));
+    dstep_text_free(&text);
+    if (!done) {
+        printf("Error: cannot format or write output file.\n");
+        exit(1);
+    }
+}
+
+// This function formats a node line of the distances matrix.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      index_t i: The node, in original ids.
+//      void *data: Unused.
+void format_distances_line(struct dstep_text *text, index_t i, void *data)
+{
+    (void)data;
+    weight_t *row = distances[new_ids == NULL ? i : new_ids[i]];
+    for (index_t j = 0; j < nodes_count; j++) {
+        dstep_text_append_distance(text, row[new_ids == NULL ? j : new_ids[j]]);
+    }
+    dstep_text_append_char(text, '\n');
+}
+
 // This function writes the found distances matrix to the output file.
 // First line contains the nodes count.
 // Last line contains -1 as EOF char.
+// If nodes were reordered, rows and columns are written in original ids order.
 void write_distances_to_file()
 {
-    fprintf(fout, "%d\n", nodes_count);
-    for (int i = 0; i < nodes_count; i++) {
-        for (int j = 0; j < nodes_count; j++) {
-            fprintf(fout, "%lf ", distances[i][j]);        
+    write_lines(format_distances_line);
+}
+
+// This function reads the edge changes file, keeping each changed edge
+// weight before and after all changes.
+void read_changes()
+{
+    index_t i, j, k;
+    double w;
+    index_t capacity = 16;
+
+    changes = (struct dstep_edge_change*)allocate_memory(capacity * sizeof(struct dstep_edge_change), "changes");
+    changes_count = 0;
+    if (fscanf(fchanges, INDEX_SCAN, &i) != 1) {
+        return;
+    }
+    while (i != -1) {
+        if (fscanf(fchanges, INDEX_SCAN " %lf \n", &j, &w) != 2 || i < 0 || j < 0 || i >= nodes_count || j >= nodes_count || i == j) {
+            printf("Error: invalid edge change.\n");
+            exit(1);
+        }
+        weight_t weight = w < 0 ? NO_WEIGHT : WEIGHT_FROM_DOUBLE(w);
+        for (k = 0; k < changes_count; k++) {
+            if ((changes[k].u == i && changes[k].v == j) || (changes[k].u == j && changes[k].v == i)) {
+                break;
+            }
+        }
+        if (k == changes_count) {
+            if (changes_count == capacity) {
+                capacity *= 2;
+                changes = (struct dstep_edge_change*)realloc(changes, capacity * sizeof(struct dstep_edge_change));
+                if (changes == NULL) {
+                    printf("Error: realloc for changes failed.\n");
+                    exit(1);
+                }
+            }
+            changes[k].u = i;
+            changes[k].v = j;
+            changes[k].old_weight = dstep_graph_weight(&graph, i, j);
+            changes_count ++;
+        }
+        changes[k].new_weight = weight;
+        if (fscanf(fchanges, INDEX_SCAN, &i) != 1) {
+            break;
+        }
+    }
+}
+
+// This function reads the previous distances matrix, written by a
+// previous run, into the distances matrix.
+// Output:
+//      1 --> Previous distances read succussfully.
+//      0 --> Something went wrong.
+int read_previous_distances()
+{
+    index_t count;
+    double distance;
+
+    if (fscanf(fprevious, INDEX_SCAN, &count) != 1 || count != nodes_count) {
+        printf("Previous distances nodes count doesn't match the Graph.\n");
+        return 0;
+    }
+    for (index_t i = 0; i < nodes_count; i++) {
+        for (index_t j = 0; j < nodes_count; j++) {
+            if (fscanf(fprevious, "%lf", &distance) != 1) {
+                printf("Previous distances file is incomplete.\n");
+                return 0;
+            }
+            distances[i][j] = distance < 0 ? NO_WEIGHT : WEIGHT_FROM_DOUBLE(distance);
+        }
+    }
+    return 1;
+}
+
+// This function repairs the previous distances after the edge changes,
+// which are applied to the Graph too.
+void update_distances()
+{
+    struct dstep_update_stats stats;
+
+    if (!dstep_update(&graph, d_step, distances, changes, changes_count, &stats)) {
+        printf("Error: malloc for update failed.\n");
+        exit(1);
+    }
+    printf("Edge changes: " INDEX_FORMAT ", repaired sources: " INDEX_FORMAT ", repaired distances: %llu, decreased edges: " INDEX_FORMAT "\n",
+           changes_count, stats.repaired, stats.reset, stats.decreased);
+}
+
+// This function retrieves the distances row of a source node from the row
+// cache, finding it with the selected engine on a miss.
+// Inputs:
+//      index_t source: The source node, in engine ids.
+// Output:
+//      weight_t * --> The distances row.
+weight_t *cached_row(index_t source)
+{
+    weight_t *row = dstep_row_cache_find(&row_cache, source);
+    if (row != NULL) {
+        return row;
+    }
+    row = dstep_row_cache_insert(&row_cache, source);
+    for (index_t i = 0; i < nodes_count; i++) {
+        row[i] = NO_WEIGHT;
+    }
+    find_row(&engine_state, source, row);
+    return row;
+}
+
+// This function answers queries read from standard input, one per line,
+// writing each answer as a line to the output file:
+//      sssp <source>          --> distances from source to all nodes.
+//      dist <source> <target> --> distance from source to target, from the
+//                                 cached source row or by a point-to-point search.
+//      stats                  --> cached rows, cache hits and misses, point-to-point searches.
+//      quit                   --> stops the server.
+// Invalid queries are answered with an error line.
+void run_server()
+{
+    char line[256], command[16];
+    index_t source, target;
+    struct dstep_text text = { NULL, 0, 0, 0 }; // Formatted sssp answer.
+
+    if (!dstep_row_cache_initialize(&row_cache, nodes_count, (index_t)(cache_mb * 1024 * 1024 / (sizeof(weight_t) * nodes_count)))) {
+        printf("Error: malloc for row cache failed.\n");
+        exit(1);
+    }
+    printf("Server ready, " INDEX_FORMAT " rows can be cached.\n", row_cache.capacity);
+    fflush(stdout);
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        int fields = sscanf(line, "%15s " INDEX_SCAN " " INDEX_SCAN, command, &source, &target);
+        if (fields < 1) {
+            continue;
+        }
+        if (strcmp(command, "quit") == 0) {
+            break;
+        } else if (strcmp(command, "stats") == 0) {
+            fprintf(fout, "cached " INDEX_FORMAT " hits %zu misses %zu pairs %zu\n", row_cache.used, row_cache.hits, row_cache.misses, pair_queries);
+        } else if (strcmp(command, "sssp") == 0 && fields == 2 && source >= 0 && source < nodes_count) {
+            weight_t *row = cached_row(new_ids == NULL ? source : new_ids[source]);
+            for (index_t j = 0; j < nodes_count; j++) {
+                dstep_text_append_distance(&text, row[new_ids == NULL ? j : new_ids[j]]);
+            }
+            dstep_text_append_char(&text, '\n');
+            if (text.failed) {
+                printf("Error: malloc for text buffer failed.\n");
+                exit(1);
+            }
+            fwrite(text.data, 1, text.size, fout);
+            text.size = 0;
+        } else if (strcmp(command, "dist") == 0 && fields == 3 && source >= 0 && source < nodes_count && target >= 0 && target < nodes_count) {
+            if (new_ids != NULL) {
+                source = new_ids[source];
+                target = new_ids[target];
+            }
+            weight_t distance;
+            if (row_cache.slots[source] != -1) {
+                distance = cached_row(source)[target];
+            } else {
+                distance = dstep_pair_distance(&pair_engine, source, target, bidirectional);
+                pair_queries ++;
+            }
+            fprintf(fout, "%lf\n", distance == NO_WEIGHT ? -1.0 : (double)distance);
+        } else {
+            fprintf(fout, "error invalid query\n");
+        }
+        fflush(fout);
+    }
+    dstep_text_free(&text);
+}
+
+// This function answers pair mode, writing the distance between the pair
+// nodes to the output file, -1 if unreachable. The point-to-point search
+// stops once the target node is settled, or both searches meet, so only
+// the region nearer than the target is explored.
+void run_pair()
+{
+    index_t source = new_ids == NULL ? pair_source : new_ids[pair_source];
+    index_t target = new_ids == NULL ? pair_target : new_ids[pair_target];
+
+    clock_t t1 = clock();
+    weight_t distance = dstep_pair_distance(&pair_engine, source, target, bidirectional);
+    clock_t t2 = clock();
+    double value = distance == NO_WEIGHT ? -1.0 : (double)distance;
+    printf("Algorithm finished!\n");
+    printf("Time spend: %f secs\n", ((float)t2 -t1) / CLOCKS_PER_SEC);
+    printf("Distance: %lf\n", value);
+    fprintf(fout, "%lf\n", value);
+}
+
+// This function formats a node line of the bounded results.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      index_t i: The node, in original ids.
+//      void *data: Unused.
+void format_bounded_line(struct dstep_text *text, index_t i, void *data)
+{
+    (void)data;
+    index_t source = new_ids == NULL ? i : new_ids[i];
+    for (size_t k = bounded_offsets[source]; k < bounded_offsets[source + 1]; k++) {
+        index_t node = bounded_results[k].node;
+        dstep_text_append_node(text, old_ids == NULL ? node : old_ids[node]);
+        dstep_text_append_char(text, ' ');
+        dstep_text_append_distance(text, bounded_results[k].distance);
+    }
+    dstep_text_append_char(text, '\n');
+}
+
+// This function writes the bounded results to the output file.
+// First line contains the nodes count. Each next line contains a node
+// results as <node> <distance> pairs, sorted by distance.
+// Last line contains -1 as EOF char.
+// If nodes were reordered, nodes are written in original ids order.
+void write_bounded_to_file()
+{
+    write_lines(format_bounded_line);
+}
+
+// This function formats a node line of the upper triangle distances.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      index_t i: The node, in original ids.
+//      void *data: Unused.
+void format_triangle_line(struct dstep_text *text, index_t i, void *data)
+{
+    (void)data;
+    for (index_t j = i + 1; j < nodes_count; j++) {
+        index_t a = new_ids == NULL ? i : new_ids[i];
+        index_t b = new_ids == NULL ? j : new_ids[j];
+        dstep_text_append_distance(text, dstep_symmetric_distance(&symmetric_engine, a, b));
+    }
+    dstep_text_append_char(text, '\n');
+}
+
+// This function writes the found upper triangle distances to the output file,
+// used in symmetric mode. First line contains the nodes count, then each
+// node line contains its distances to all nodes with greater ids.
+// Last line contains -1 as EOF char.
+// If nodes were reordered, rows and columns are written in original ids order.
+void write_triangle_to_file()
+{
+    write_lines(format_triangle_line);
+}
+
+// This function prints the phases and node scans counts of the batched
+// engine, added over all workers.
+void print_phases()
+{
+    size_t phases = engine_state.solver.phases, scans = engine_state.solver.scans;
+    for (index_t w = 0; workers != NULL && w < threads_count; w++) {
+        phases += workers[w].state.solver.phases;
+        scans += workers[w].state.solver.scans;
+    }
+    printf("Phases: %zu, node scans: %zu\n", phases, scans);
+}
+
+// This function initializes the selected engine.
+void initialize_engine()
+{
+    int done = 1;
+
+    if (radius >= 0 || nearest > 0 || pair_source >= 0) {
+        if (!dstep_pair_initialize(&pair_engine, &graph, d_step)) {
+            printf("Error: malloc for point-to-point engine failed.\n");
+            exit(1);
         }
-        fprintf(fout, "\n");
+        if (pair_source >= 0) {
+            return;
+        }
+        bounded_offsets = (size_t*)allocate_memory((nodes_count + 1) * sizeof(size_t), "bounded offsets");
+        bounded_offsets[0] = 0;
+        return;
+    }
+    if (symmetric) {
+        if (!dstep_symmetric_initialize(&symmetric_engine, &graph, d_step) ||
+            !dstep_context_strategy(&symmetric_engine.context, strategy, rho)) {
+            printf("Error: malloc for symmetric engine failed.\n");
+            exit(1);
+        }
+        return;
+    }
+    select_engine();
+    if (!server) {
+        initialize_distances();
+    }
+    if (engine == ENGINE_RADIX) {
+        check_radix_scale();
+        done = dstep_radix_graph_initialize(&radix_graph, &graph, d_step, scale);
+    } else if (engine == ENGINE_DENSE) {
+        done = dstep_dense_graph_initialize(&dense_graph, &graph);
+    }
+    if (!done) {
+        printf("Error: malloc for engine Graph failed.\n");
+        exit(1);
+    }
+    initialize_engine_state(&engine_state, &radix_graph, &dense_graph, &graph);
+    if (threads_count > 1) {
+        initialize_workers();
+    }
+    if (server && !dstep_pair_initialize(&pair_engine, &graph, d_step)) {
+        printf("Error: malloc for point-to-point engine failed.\n");
+        exit(1);
     }
-    fprintf(fout, "-1");
 }
 
 int main(int argc, char **argv)
 {
     // Run-time parameters check.
-    if (!read_parameters(argv)) {
+    if (!read_parameters(argc, argv)) {
         printf("Program terminates.\n");
         return -1;    
     }
 
-    fscanf(fin, "%d \n", &nodes_count); // Retrieve Graph nodes count.
+    if (!initialize_graph()) {
+        printf("Program terminates.\n");
+        return -1;
+    }
     if (nodes_count > 0) {
-        printf("Nodes count: %d\n", nodes_count);
+        printf("Nodes count: " INDEX_FORMAT "\n", nodes_count);
         printf("Algorithm started, please wait...\n");    
-        initialize_matrix();
-        initialize_structures();
+        reorder_graph();
+        if (fchanges != NULL) {
+            read_changes();
+            initialize_distances();
+            if (!read_previous_distances()) {
+                printf("Program terminates.\n");
+                return -1;
+            }
+        } else {
+            label_components();
+            initialize_engine();
+        }
+        if (checkpoint_filename != NULL) {
+            open_checkpoint();
+        }
+        if (pair_source >= 0) {
+            if (pair_source >= nodes_count || pair_target >= nodes_count) {
+                printf("Pair nodes must be lower than nodes count.\n");
+                free_structures();
+                fclose(fin);
+                fclose(fout);
+                printf("Program terminates.\n");
+                return -1;
+            }
+            run_pair();
+            free_structures();
+            fclose(fin);
+            fclose(fout);
+            printf("Program terminates.\n");
+            return 0;
+        }
+        if (server) {
+            run_server();
+            free_structures();
+            fclose(fin);
+            fclose(fout);
+            printf("Program terminates.\n");
+            return 0;
+        }
         // Retrieve shortest path distances from each node to all other nodes of the Graph.    
         clock_t t1 = clock();        
-        for (source_node = 0; source_node<nodes_count; source_node++) {
-            d_step_algorithm();
-            reset_node_structures();
-        }    
+        struct timespec w1, w2;
+        clock_gettime(CLOCK_MONOTONIC, &w1);
+        if (fchanges != NULL) {
+            update_distances();
+        } else if (threads_count > 1) {
+            schedule_sources();
+        } else {
+            for (index_t source = 0; source < nodes_count; source++) {
+                if (source_completed(source)) {
+                    continue;
+                }
+                find_distances(source);
+                checkpoint_source(source);
+            }
+        }
         clock_t t2 = clock();
+        clock_gettime(CLOCK_MONOTONIC, &w2);
+        close_checkpoint();
         printf("Algorithm finished!\n");
         printf("Time spend: %f secs\n", ((float)t2 -t1) / CLOCKS_PER_SEC);
+        if (threads_count > 1) {
+            // Processor time above adds all threads.
+            printf("Wall time: %f secs\n", (w2.tv_sec - w1.tv_sec) + (w2.tv_nsec - w1.tv_nsec) / 1e9);
+        }
+        if (engine == ENGINE_BUCKETS || engine == ENGINE_BATCHED) {
+            print_phases();
+        }
         printf("Writing distances to output file.\n");
-        write_distances_to_file();    
+        if (radius >= 0 || nearest > 0) {
+            write_bounded_to_file();
+        } else if (symmetric) {
+            write_triangle_to_file();
+        } else {
+            write_distances_to_file();    
+        }
         free_structures();    
     } else {
         printf("File is empty.\n");        
     }
     fclose(fin);
     fclose(fout);
+    if (fchanges != NULL) {
+        fclose(fprevious);
+        fclose(fchanges);
+    }
     printf("Program terminates.\n");
     return 0;
 }
@@ -0,0 +1,2724 @@
+// -------------------------------------------------------
+//
+// D-Stepping library, implementing the D-Stepping algorithm
+// introduced by U.Mayers and P.Sanders as reentrant calls.
+// All state lives in the Graph and solver context structures,
+// see dstep.h.
+//
+// -------------------------------------------------------
+
+#include "dstep.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Distances below this bound are formatted with integer arithmetic, as
+// their 6 decimals digits fit 64 bits.
+#define FORMAT_FAST_BOUND 1e12
+
+// Dense engine rows are padded to a multiple of DENSE_WIDTH weights,
+// so each row starts 32-bytes aligned and SIMD loops have no tail.
+#define DENSE_WIDTH (index_t)(32 / sizeof(weight_t))
+#define DENSE_CLEAN 0    // Node has no pending relaxation.
+#define DENSE_PENDING 1  // Node distance changed, row must be relaxed.
+#define DENSE_SETTLED 2  // Node distance is final.
+
+// Scaled weights within RADIX_TOLERANCE, relative, of an integer are
+// considered integers, as weights hold rounding errors of their type.
+#ifdef WEIGHT_FLOAT
+#define RADIX_TOLERANCE 1e-6
+#else
+#define RADIX_TOLERANCE 1e-9
+#endif
+
+// Text writer structure, formatting a block of output lines in a thread.
+struct dstep_text_writer {
+    pthread_t thread;              // Thread.
+    struct dstep_text text;        // Formatted lines.
+    index_t first;                 // First line.
+    index_t last;                  // Line after the last one.
+    dstep_format_line format_line; // Line formatter.
+    void *data;                    // Line formatter data.
+};
+
+// Edge structure, used while reading a Graph.
+struct dstep_edge {
+    index_t target;   // Target node.
+    weight_t weight;  // Weight.
+};
+
+// This function initializes linked buckets, all empty.
+// Inputs:
+//      struct dstep_buckets *buckets: The linked buckets.
+//      index_t count: Buckets count.
+//      index_t nodes_count: Nodes count.
+// Output:
+//      1 --> Linked buckets initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_buckets_initialize(struct dstep_buckets *buckets, index_t count, index_t nodes_count)
+{
+    buckets->heads = (index_t*)malloc(count * sizeof(index_t));
+    buckets->next = (index_t*)malloc(nodes_count * sizeof(index_t));
+    buckets->prev = (index_t*)malloc(nodes_count * sizeof(index_t));
+    buckets->node_buckets = (index_t*)malloc(nodes_count * sizeof(index_t));
+    if (buckets->heads == NULL || buckets->next == NULL || buckets->prev == NULL || buckets->node_buckets == NULL) {
+        dstep_buckets_free(buckets);
+        return 0;
+    }
+    for (index_t i = 0; i < count; i++) {
+        buckets->heads[i] = -1;
+    }
+    for (index_t i = 0; i < nodes_count; i++) {
+        buckets->node_buckets[i] = -1;
+    }
+    buckets->count = count;
+    buckets->queued = 0;
+    return 1;
+}
+
+// This function frees allocated memory of linked buckets.
+// Inputs:
+//      struct dstep_buckets *buckets: The linked buckets.
+void dstep_buckets_free(struct dstep_buckets *buckets)
+{
+    free(buckets->heads);
+    free(buckets->next);
+    free(buckets->prev);
+    free(buckets->node_buckets);
+    buckets->heads = NULL;
+    buckets->next = NULL;
+    buckets->prev = NULL;
+    buckets->node_buckets = NULL;
+}
+
+// This function inserts a node at the head of a bucket.
+// Inputs:
+//      struct dstep_buckets *buckets: The linked buckets.
+//      index_t node: The node, not contained in any bucket.
+//      index_t bucket: The bucket.
+void dstep_buckets_insert(struct dstep_buckets *buckets, index_t node, index_t bucket)
+{
+    buckets->prev[node] = -1;
+    buckets->next[node] = buckets->heads[bucket];
+    if (buckets->heads[bucket] != -1) {
+        buckets->prev[buckets->heads[bucket]] = node;
+    }
+    buckets->heads[bucket] = node;
+    buckets->node_buckets[node] = bucket;
+    buckets->queued ++;
+}
+
+// This function removes a node from its bucket.
+// Inputs:
+//      struct dstep_buckets *buckets: The linked buckets.
+//      index_t node: The node, contained in a bucket.
+void dstep_buckets_remove(struct dstep_buckets *buckets, index_t node)
+{
+    index_t bucket = buckets->node_buckets[node];
+    if (buckets->prev[node] != -1) {
+        buckets->next[buckets->prev[node]] = buckets->next[node];
+    } else {
+        buckets->heads[bucket] = buckets->next[node];
+    }
+    if (buckets->next[node] != -1) {
+        buckets->prev[buckets->next[node]] = buckets->prev[node];
+    }
+    buckets->node_buckets[node] = -1;
+    buckets->queued --;
+}
+
+// This function allocates a Graph compressed rows for a given edges count.
+// Inputs:
+//      struct dstep_graph *graph: The Graph, with its nodes count set.
+//      size_t edges: Edges count.
+// Output:
+//      1 --> Graph allocated successfully.
+//      0 --> Memory allocation failed.
+static int allocate_graph(struct dstep_graph *graph, size_t edges)
+{
+    graph->components = NULL;
+    graph->component_offsets = NULL;
+    graph->component_nodes = NULL;
+    graph->component_edges = NULL;
+    graph->offsets = (index_t*)malloc((graph->nodes_count + 1) * sizeof(index_t));
+    graph->targets = (index_t*)malloc((edges > 0 ? edges : 1) * sizeof(index_t));
+    graph->weights = (weight_t*)malloc((edges > 0 ? edges : 1) * sizeof(weight_t));
+    if (graph->offsets == NULL || graph->targets == NULL || graph->weights == NULL) {
+        dstep_graph_free(graph);
+        return 0;
+    }
+    graph->max_weight = 0;
+    graph->components_count = 0;
+    return 1;
+}
+
+// This function initializes a Graph from a nodes matrix, where missing
+// edges are NO_WEIGHT. Each node edges are stored by ascending target.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+//      index_t nodes_count: Nodes count.
+//      weight_t **matrix: The nodes matrix.
+// Output:
+//      1 --> Graph initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_graph_initialize(struct dstep_graph *graph, index_t nodes_count, weight_t **matrix)
+{
+    index_t i, j;
+    size_t edges = 0, pos = 0;
+
+    for (i = 0; i < nodes_count; i++) {
+        for (j = 0; j < nodes_count; j++) {
+            if (matrix[i][j] != NO_WEIGHT) {
+                edges ++;
+            }
+        }
+    }
+    graph->nodes_count = nodes_count;
+    if (!allocate_graph(graph, edges)) {
+        return 0;
+    }
+    graph->offsets[0] = 0;
+    for (i = 0; i < nodes_count; i++) {
+        for (j = 0; j < nodes_count; j++) {
+            if (matrix[i][j] != NO_WEIGHT) {
+                graph->targets[pos] = j;
+                graph->weights[pos] = matrix[i][j];
+                if (matrix[i][j] > graph->max_weight) {
+                    graph->max_weight = matrix[i][j];
+                }
+                pos ++;
+            }
+        }
+        graph->offsets[i + 1] = pos;
+    }
+    return 1;
+}
+
+// Edge change structure, used while updating a Graph.
+struct dstep_change {
+    index_t source;  // Source node.
+    index_t target;  // Target node.
+    weight_t weight; // New weight, NO_WEIGHT to delete the edge.
+    size_t order;    // Change position, the last change of an edge wins.
+};
+
+// This function compares edges by target, then weight.
+// Inputs:
+//      const void *a: First edge.
+//      const void *b: Second edge.
+// Output:
+//      int --> Negative, zero or positive as a is before, equal or after b.
+static int compare_edges(const void *a, const void *b)
+{
+    const struct dstep_edge *x = (const struct dstep_edge*)a;
+    const struct dstep_edge *y = (const struct dstep_edge*)b;
+    if (x->target != y->target) {
+        return x->target < y->target ? -1 : 1;
+    }
+    return (x->weight > y->weight) - (x->weight < y->weight);
+}
+
+// This function initializes a Graph by reading a file created by RandomGraph:
+// the nodes count, then <node> <node> <weight> edges, ending with -1.
+// Edges are undirected, self loops are skipped and only the lightest of
+// duplicate edges is kept, as in a nodes matrix. Each node edges are stored
+// by ascending target.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+//      FILE *file: The file.
+// Output:
+//      1 --> Graph read successfully.
+//      0 --> Invalid file or memory allocation failed.
+int dstep_graph_read(struct dstep_graph *graph, FILE *file)
+{
+    index_t i, j, nodes_count;
+    double w;
+    size_t count = 0, capacity = 1024, pos = 0;
+
+    if (fscanf(file, INDEX_SCAN, &nodes_count) != 1 || nodes_count < 0) {
+        return 0;
+    }
+    index_t *sources = (index_t*)malloc(capacity * sizeof(index_t));
+    struct dstep_edge *edges = (struct dstep_edge*)malloc(capacity * sizeof(struct dstep_edge));
+    index_t *offsets = (index_t*)calloc(nodes_count + 1, sizeof(index_t));
+    if (sources == NULL || edges == NULL || offsets == NULL) {
+        free(sources);
+        free(edges);
+        free(offsets);
+        return 0;
+    }
+    // Read each edge in both directions.
+    while (fscanf(file, INDEX_SCAN, &i) == 1 && i != -1) {
+        if (fscanf(file, INDEX_SCAN " %lf", &j, &w) != 2 || i < 0 || j < 0 || i >= nodes_count || j >= nodes_count) {
+            free(sources);
+            free(edges);
+            free(offsets);
+            return 0;
+        }
+        if (i == j) {
+            continue;
+        }
+        if (count + 2 > capacity) {
+            capacity *= 2;
+            index_t *more_sources = (index_t*)realloc(sources, capacity * sizeof(index_t));
+            struct dstep_edge *more_edges = (struct dstep_edge*)realloc(edges, capacity * sizeof(struct dstep_edge));
+            sources = more_sources != NULL ? more_sources : sources;
+            edges = more_edges != NULL ? more_edges : edges;
+            if (more_sources == NULL || more_edges == NULL) {
+                free(sources);
+                free(edges);
+                free(offsets);
+                return 0;
+            }
+        }
+        sources[count] = i;
+        edges[count].target = j;
+        edges[count].weight = WEIGHT_FROM_DOUBLE(w);
+        sources[count + 1] = j;
+        edges[count + 1].target = i;
+        edges[count + 1].weight = WEIGHT_FROM_DOUBLE(w);
+        offsets[i + 1] ++;
+        offsets[j + 1] ++;
+        count += 2;
+    }
+    // Group edges by source node, then keep the lightest of each target.
+    for (i = 0; i < nodes_count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    struct dstep_edge *grouped = (struct dstep_edge*)malloc((count > 0 ? count : 1) * sizeof(struct dstep_edge));
+    if (grouped == NULL) {
+        free(sources);
+        free(edges);
+        free(offsets);
+        return 0;
+    }
+    for (size_t k = 0; k < count; k++) {
+        grouped[offsets[sources[k]]++] = edges[k];
+    }
+    for (i = nodes_count; i > 0; i--) {
+        offsets[i] = offsets[i - 1];
+    }
+    offsets[0] = 0;
+    free(sources);
+    free(edges);
+
+    graph->nodes_count = nodes_count;
+    if (!allocate_graph(graph, count)) {
+        free(grouped);
+        free(offsets);
+        return 0;
+    }
+    graph->offsets[0] = 0;
+    for (i = 0; i < nodes_count; i++) {
+        qsort(grouped + offsets[i], offsets[i + 1] - offsets[i], sizeof(struct dstep_edge), compare_edges);
+        for (index_t k = offsets[i]; k < offsets[i + 1]; k++) {
+            if (k > offsets[i] && grouped[k].target == grouped[k - 1].target) {
+                continue;
+            }
+            graph->targets[pos] = grouped[k].target;
+            graph->weights[pos] = grouped[k].weight;
+            if (grouped[k].weight > graph->max_weight) {
+                graph->max_weight = grouped[k].weight;
+            }
+            pos ++;
+        }
+        graph->offsets[i + 1] = pos;
+    }
+    free(grouped);
+    free(offsets);
+    return 1;
+}
+
+// This function relabels a Graph nodes, each node taking its new id, and
+// stores each node edges by ascending new target. Components labels are dropped.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+//      const index_t *new_ids: New id of each node, a permutation.
+// Output:
+//      1 --> Graph relabelled successfully.
+//      0 --> Memory allocation failed, the Graph is unchanged.
+int dstep_graph_permute(struct dstep_graph *graph, const index_t *new_ids)
+{
+    index_t i, k, nodes_count = graph->nodes_count;
+    index_t degree = 0, pos = 0;
+    struct dstep_graph permuted;
+
+    for (i = 0; i < nodes_count; i++) {
+        if (graph->offsets[i + 1] - graph->offsets[i] > degree) {
+            degree = graph->offsets[i + 1] - graph->offsets[i];
+        }
+    }
+    permuted.nodes_count = nodes_count;
+    index_t *old_ids = (index_t*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(index_t));
+    struct dstep_edge *row = (struct dstep_edge*)malloc((degree > 0 ? degree : 1) * sizeof(struct dstep_edge));
+    if (old_ids == NULL || row == NULL || !allocate_graph(&permuted, graph->offsets[nodes_count])) {
+        free(old_ids);
+        free(row);
+        return 0;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        old_ids[new_ids[i]] = i;
+    }
+    permuted.offsets[0] = 0;
+    for (i = 0; i < nodes_count; i++) {
+        index_t node = old_ids[i];
+        index_t count = graph->offsets[node + 1] - graph->offsets[node];
+        for (k = 0; k < count; k++) {
+            row[k].target = new_ids[graph->targets[graph->offsets[node] + k]];
+            row[k].weight = graph->weights[graph->offsets[node] + k];
+        }
+        qsort(row, count, sizeof(struct dstep_edge), compare_edges);
+        for (k = 0; k < count; k++) {
+            permuted.targets[pos] = row[k].target;
+            permuted.weights[pos] = row[k].weight;
+            pos ++;
+        }
+        permuted.offsets[i + 1] = pos;
+    }
+    permuted.max_weight = graph->max_weight;
+    free(old_ids);
+    free(row);
+    dstep_graph_free(graph);
+    *graph = permuted;
+    return 1;
+}
+
+// This function returns the weight of an edge, searching the source node
+// edges, stored by ascending target.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      index_t source: The source node.
+//      index_t target: The target node.
+// Output:
+//      weight_t --> The edge weight, NO_WEIGHT if missing.
+weight_t dstep_graph_weight(const struct dstep_graph *graph, index_t source, index_t target)
+{
+    index_t low = graph->offsets[source], high = graph->offsets[source + 1];
+    while (low < high) {
+        index_t middle = low + (high - low) / 2;
+        if (graph->targets[middle] < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < graph->offsets[source + 1] && graph->targets[low] == target ? graph->weights[low] : NO_WEIGHT;
+}
+
+// This function compares edge changes by source, target, then position.
+// Inputs:
+//      const void *a: First change.
+//      const void *b: Second change.
+// Output:
+//      int --> Negative, zero or positive as a is before, equal or after b.
+static int compare_changes(const void *a, const void *b)
+{
+    const struct dstep_change *x = (const struct dstep_change*)a;
+    const struct dstep_change *y = (const struct dstep_change*)b;
+    if (x->source != y->source) {
+        return x->source < y->source ? -1 : 1;
+    }
+    if (x->target != y->target) {
+        return x->target < y->target ? -1 : 1;
+    }
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+// This function merges a Graph edges with sorted edge changes into new
+// compressed rows, or only counts the merged edges.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      const struct dstep_change *changes: The changes, sorted.
+//      size_t count: Changes count.
+//      struct dstep_graph *merged: The merged Graph, allocated, or NULL to count edges.
+// Output:
+//      size_t --> Merged edges count.
+static size_t merge_changes(const struct dstep_graph *graph, const struct dstep_change *changes, size_t count, struct dstep_graph *merged)
+{
+    size_t pos = 0, c = 0;
+
+    for (index_t i = 0; i < graph->nodes_count; i++) {
+        index_t k = graph->offsets[i];
+        while (k < graph->offsets[i + 1] || (c < count && changes[c].source == i)) {
+            index_t target;
+            weight_t weight;
+            if (c < count && changes[c].source == i && (k == graph->offsets[i + 1] || changes[c].target <= graph->targets[k])) {
+                // Changed edge, its last change wins.
+                target = changes[c].target;
+                while (c + 1 < count && changes[c + 1].source == i && changes[c + 1].target == target) {
+                    c ++;
+                }
+                weight = changes[c++].weight;
+                if (k < graph->offsets[i + 1] && graph->targets[k] == target) {
+                    k ++;
+                }
+            } else {
+                target = graph->targets[k];
+                weight = graph->weights[k++];
+            }
+            if (weight == NO_WEIGHT) {
+                continue;
+            }
+            if (merged != NULL) {
+                merged->targets[pos] = target;
+                merged->weights[pos] = weight;
+                if (weight > merged->max_weight) {
+                    merged->max_weight = weight;
+                }
+            }
+            pos ++;
+        }
+        if (merged != NULL) {
+            merged->offsets[i + 1] = pos;
+        }
+    }
+    return pos;
+}
+
+// This function changes undirected edges of a Graph: missing edges are
+// inserted, existing ones get their new weight, and NO_WEIGHT deletes them.
+// When an edge is changed more than once, its last change wins.
+// Components labels are dropped.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+//      size_t count: Changes count.
+//      const index_t *sources: First node of each changed edge.
+//      const index_t *targets: Second node of each changed edge.
+//      const weight_t *weights: New weight of each changed edge.
+// Output:
+//      1 --> Graph changed successfully.
+//      0 --> Memory allocation failed, the Graph is unchanged.
+int dstep_graph_update(struct dstep_graph *graph, size_t count, const index_t *sources, const index_t *targets, const weight_t *weights)
+{
+    struct dstep_graph merged;
+    size_t directed = 0;
+    struct dstep_change *changes = (struct dstep_change*)malloc((count > 0 ? 2 * count : 1) * sizeof(struct dstep_change));
+
+    if (changes == NULL) {
+        return 0;
+    }
+    // Each change applies in both directions, self loops are skipped.
+    for (size_t k = 0; k < count; k++) {
+        if (sources[k] == targets[k]) {
+            continue;
+        }
+        changes[directed].source = sources[k];
+        changes[directed].target = targets[k];
+        changes[directed].weight = weights[k];
+        changes[directed].order = k;
+        changes[directed + 1].source = targets[k];
+        changes[directed + 1].target = sources[k];
+        changes[directed + 1].weight = weights[k];
+        changes[directed + 1].order = k;
+        directed += 2;
+    }
+    qsort(changes, directed, sizeof(struct dstep_change), compare_changes);
+    merged.nodes_count = graph->nodes_count;
+    if (!allocate_graph(&merged, merge_changes(graph, changes, directed, NULL))) {
+        free(changes);
+        return 0;
+    }
+    merged.offsets[0] = 0;
+    merge_changes(graph, changes, directed, &merged);
+    free(changes);
+    dstep_graph_free(graph);
+    *graph = merged;
+    return 1;
+}
+
+// Ranked node structure, used while reordering a Graph.
+struct dstep_ranked {
+    index_t degree; // Node degree.
+    index_t node;   // Node.
+};
+
+// This function compares ranked nodes by degree, then node. Ties keep
+// node ids order, so orderings are deterministic.
+// Inputs:
+//      const void *a: First ranked node.
+//      const void *b: Second ranked node.
+// Output:
+//      int --> Negative, zero or positive as a is before, equal or after b.
+static int compare_ranked(const void *a, const void *b)
+{
+    const struct dstep_ranked *x = (const struct dstep_ranked*)a;
+    const struct dstep_ranked *y = (const struct dstep_ranked*)b;
+    if (x->degree != y->degree) {
+        return x->degree < y->degree ? -1 : 1;
+    }
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+// This function orders nodes by Reverse Cuthill-McKee: each component is
+// traversed in BFS order starting from its lowest degree node, visiting
+// neighbors by increasing degree, and the resulting order is reversed.
+// Neighbors end up with close ids, so their distances share cache lines.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      struct dstep_ranked *by_degree: Nodes ranked by degree, sorted.
+//      struct dstep_ranked *order: Nodes count entries to store the order.
+// Output:
+//      1 --> Nodes ordered successfully.
+//      0 --> Memory allocation failed.
+static int rcm_order(const struct dstep_graph *graph, const struct dstep_ranked *by_degree, struct dstep_ranked *order)
+{
+    index_t k, head, tail = 0, nodes_count = graph->nodes_count;
+    char *visited = (char*)calloc(nodes_count, sizeof(char));
+
+    if (visited == NULL) {
+        return 0;
+    }
+    for (index_t start = 0; start < nodes_count; start++) {
+        if (visited[by_degree[start].node]) {
+            continue;
+        }
+        head = tail;
+        order[tail++] = by_degree[start];
+        visited[by_degree[start].node] = 1;
+        while (head < tail) {
+            index_t node = order[head++].node;
+            index_t first = tail;
+            for (k = graph->offsets[node]; k < graph->offsets[node + 1]; k++) {
+                index_t target = graph->targets[k];
+                if (!visited[target]) {
+                    visited[target] = 1;
+                    order[tail].degree = graph->offsets[target + 1] - graph->offsets[target];
+                    order[tail++].node = target;
+                }
+            }
+            qsort(order + first, tail - first, sizeof(struct dstep_ranked), compare_ranked);
+        }
+    }
+    free(visited);
+    return 1;
+}
+
+// This function relabels a Graph nodes for locality, by Reverse Cuthill-McKee
+// or descending degree ordering, so high degree nodes, visited the most, are
+// packed together. Components labels are dropped.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+//      enum dstep_ordering ordering: The ordering.
+//      index_t *new_ids: Nodes count entries to store the new id of each node.
+//      index_t *old_ids: Nodes count entries to store the previous id of each new id.
+// Output:
+//      1 --> Graph reordered successfully.
+//      0 --> Memory allocation failed, the Graph is unchanged.
+int dstep_graph_reorder(struct dstep_graph *graph, enum dstep_ordering ordering, index_t *new_ids, index_t *old_ids)
+{
+    index_t i, nodes_count = graph->nodes_count;
+    struct dstep_ranked *by_degree = (struct dstep_ranked*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(struct dstep_ranked));
+    struct dstep_ranked *order = (struct dstep_ranked*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(struct dstep_ranked));
+
+    if (by_degree == NULL || order == NULL) {
+        free(by_degree);
+        free(order);
+        return 0;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        by_degree[i].degree = graph->offsets[i + 1] - graph->offsets[i];
+        by_degree[i].node = i;
+    }
+    qsort(by_degree, nodes_count, sizeof(struct dstep_ranked), compare_ranked);
+    if (ordering == DSTEP_ORDERING_RCM && !rcm_order(graph, by_degree, order)) {
+        free(by_degree);
+        free(order);
+        return 0;
+    }
+    // Both orderings are reversed: RCM by definition, degree for descending degrees.
+    for (i = 0; i < nodes_count; i++) {
+        old_ids[nodes_count - 1 - i] = ordering == DSTEP_ORDERING_RCM ? order[i].node : by_degree[i].node;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        new_ids[old_ids[i]] = i;
+    }
+    free(by_degree);
+    free(order);
+    return dstep_graph_permute(graph, new_ids);
+}
+
+// This function finds the union-find root of a node, halving its path.
+// Inputs:
+//      index_t *parents: Union-find parent of each node.
+//      index_t node: The node.
+// Output:
+//      index_t --> The root node.
+static index_t find_root(index_t *parents, index_t node)
+{
+    while (parents[node] != node) {
+        parents[node] = parents[parents[node]];
+        node = parents[node];
+    }
+    return node;
+}
+
+// This function joins the union-find sets of two nodes connected by an edge,
+// attaching the smaller set to the larger one.
+// Inputs:
+//      index_t *parents: Union-find parent of each node.
+//      index_t *sizes: Union-find size of each root node.
+//      index_t a: First node.
+//      index_t b: Second node.
+static void union_nodes(index_t *parents, index_t *sizes, index_t a, index_t b)
+{
+    a = find_root(parents, a);
+    b = find_root(parents, b);
+    if (a == b) {
+        return;
+    }
+    if (sizes[a] < sizes[b]) {
+        index_t temp = a;
+        a = b;
+        b = temp;
+    }
+    parents[b] = a;
+    sizes[a] += sizes[b];
+}
+
+// This function labels the connected components of a Graph by union-find,
+// numbering them by their lowest node, groups nodes by component and
+// counts each component edges.
+// Searches then only visit the source node component, and leave distances
+// to other nodes untouched.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+// Output:
+//      1 --> Components labelled successfully.
+//      0 --> Memory allocation failed.
+int dstep_graph_components(struct dstep_graph *graph)
+{
+    index_t i, k, nodes_count = graph->nodes_count;
+    size_t size = (nodes_count > 0 ? nodes_count : 1) * sizeof(index_t);
+    index_t *parents = (index_t*)malloc(size);
+    index_t *sizes = (index_t*)malloc(size);
+
+    free(graph->components);
+    free(graph->component_offsets);
+    free(graph->component_nodes);
+    free(graph->component_edges);
+    graph->components_count = 0;
+    graph->components = (index_t*)malloc(size);
+    graph->component_nodes = (index_t*)malloc(size);
+    graph->component_offsets = (index_t*)calloc(nodes_count + 1, sizeof(index_t));
+    graph->component_edges = (index_t*)calloc(nodes_count > 0 ? nodes_count : 1, sizeof(index_t));
+    if (parents == NULL || sizes == NULL || graph->components == NULL || graph->component_nodes == NULL ||
+        graph->component_offsets == NULL || graph->component_edges == NULL) {
+        free(parents);
+        free(sizes);
+        free(graph->components);
+        free(graph->component_offsets);
+        free(graph->component_nodes);
+        free(graph->component_edges);
+        graph->components = NULL;
+        graph->component_offsets = NULL;
+        graph->component_nodes = NULL;
+        graph->component_edges = NULL;
+        return 0;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        parents[i] = i;
+        sizes[i] = 1;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        for (k = graph->offsets[i]; k < graph->offsets[i + 1]; k++) {
+            union_nodes(parents, sizes, i, graph->targets[k]);
+        }
+    }
+    index_t *roots = sizes; // Sizes are not needed anymore, reused as root labels.
+    for (i = 0; i < nodes_count; i++) {
+        roots[i] = -1;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        index_t root = find_root(parents, i);
+        if (roots[root] == -1) {
+            roots[root] = graph->components_count++;
+        }
+        graph->components[i] = roots[root];
+        graph->component_offsets[roots[root] + 1] ++;
+        graph->component_edges[roots[root]] += graph->offsets[i + 1] - graph->offsets[i];
+    }
+    for (i = 0; i < graph->components_count; i++) {
+        graph->component_offsets[i + 1] += graph->component_offsets[i];
+    }
+    for (i = 0; i < nodes_count; i++) {
+        graph->component_nodes[graph->component_offsets[graph->components[i]]++] = i;
+    }
+    for (i = graph->components_count; i > 0; i--) {
+        graph->component_offsets[i] = graph->component_offsets[i - 1];
+    }
+    graph->component_offsets[0] = 0;
+    free(parents);
+    free(sizes);
+    return 1;
+}
+
+// This function returns the nodes count of a node connected component.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      index_t node: The node.
+// Output:
+//      index_t --> The component nodes count, the nodes count if not labelled.
+index_t dstep_component_size(const struct dstep_graph *graph, index_t node)
+{
+    if (graph->components == NULL) {
+        return graph->nodes_count;
+    }
+    return graph->component_offsets[graph->components[node] + 1] - graph->component_offsets[graph->components[node]];
+}
+
+// This function estimates the cost of a search from a source node, as the
+// nodes and edges it scans at least once: those of its component, the
+// whole Graph when components are not labelled. Isolated nodes cost
+// nothing, as their rows are left empty.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      index_t source: The source node.
+// Output:
+//      double --> The estimated cost.
+double dstep_search_cost(const struct dstep_graph *graph, index_t source)
+{
+    if (graph->components == NULL) {
+        return (double)graph->nodes_count + graph->offsets[graph->nodes_count];
+    }
+    index_t size = dstep_component_size(graph, source);
+    return size == 1 ? 0 : (double)size + graph->component_edges[graph->components[source]];
+}
+
+// This function returns the nodes a search from a source node may reach:
+// its component nodes, or all nodes when components are not labelled.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      index_t source: The source node.
+//      index_t *count: Stores the nodes count.
+// Output:
+//      const index_t * --> The nodes, NULL for all nodes in ids order.
+static const index_t *reachable_nodes(const struct dstep_graph *graph, index_t source, index_t *count)
+{
+    *count = dstep_component_size(graph, source);
+    if (graph->components == NULL) {
+        return NULL;
+    }
+    return graph->component_nodes + graph->component_offsets[graph->components[source]];
+}
+
+// This function checks whether two nodes lie in the same component,
+// always true when components are not labelled.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      index_t a: First node.
+//      index_t b: Second node.
+// Output:
+//      1 --> Same component.
+//      0 --> Different components.
+static int same_component(const struct dstep_graph *graph, index_t a, index_t b)
+{
+    return graph->components == NULL || graph->components[a] == graph->components[b];
+}
+
+// This function frees allocated memory of a Graph.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+void dstep_graph_free(struct dstep_graph *graph)
+{
+    free(graph->offsets);
+    free(graph->targets);
+    free(graph->weights);
+    free(graph->components);
+    free(graph->component_offsets);
+    free(graph->component_nodes);
+    free(graph->component_edges);
+    graph->offsets = NULL;
+    graph->targets = NULL;
+    graph->weights = NULL;
+    graph->components = NULL;
+    graph->component_offsets = NULL;
+    graph->component_nodes = NULL;
+    graph->component_edges = NULL;
+    graph->components_count = 0;
+}
+
+// This function initializes a solver context on a Graph, with the fixed
+// bucket strategy. Buckets are cyclic, covering the heaviest edge and the
+// widest phase, so their count is bounded.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      const struct dstep_graph *graph: The Graph, shared by contexts.
+//      double d_step: The D value, positive.
+// Output:
+//      1 --> Solver context initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_context_initialize(struct dstep_context *context, const struct dstep_graph *graph, double d_step)
+{
+    index_t nodes_count = graph->nodes_count;
+    size_t batch_size = sizeof(weight_t) * BATCH_SIZE * (nodes_count > 0 ? nodes_count : 1);
+
+    memset(context, 0, sizeof(struct dstep_context));
+    context->graph = graph;
+    context->d_step = d_step;
+    context->bucket_width = d_step;
+    context->strategy = DSTEP_STRATEGY_FIXED;
+    context->width = 1;
+    context->distances = (weight_t*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(weight_t));
+    context->batch_distances = (weight_t*)aligned_alloc(32, (batch_size + 31) / 32 * 32);
+    context->pending = (weight_t*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(weight_t));
+    context->scanned = (size_t*)calloc(nodes_count > 0 ? nodes_count : 1, sizeof(size_t));
+    if (context->distances == NULL || context->batch_distances == NULL || context->pending == NULL || context->scanned == NULL
+        || !dstep_buckets_initialize(&context->buckets, (index_t)(graph->max_weight / d_step) + 2, nodes_count)) {
+        dstep_context_free(context);
+        return 0;
+    }
+    for (index_t i = 0; i < nodes_count; i++) {
+        context->distances[i] = WEIGHT_INFINITY;
+    }
+    return 1;
+}
+
+// This function frees allocated memory of a solver context.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+void dstep_context_free(struct dstep_context *context)
+{
+    free(context->distances);
+    free(context->batch_distances);
+    free(context->pending);
+    free(context->radii);
+    free(context->scanned);
+    dstep_buckets_free(&context->buckets);
+    context->distances = NULL;
+    context->batch_distances = NULL;
+    context->pending = NULL;
+    context->radii = NULL;
+    context->scanned = NULL;
+}
+
+// This function sets the bucket strategy of a solver context. The adaptive
+// and radius strategies split each D into DSTEP_PHASE_SPLIT buckets, and
+// buckets also cover the widest phase. The radius strategy uses the weight
+// of each node rho-th lightest edge as its radius, an upper bound of the
+// distance to its rho-th nearest node, or its heaviest edge when it has
+// fewer edges.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      enum dstep_strategy strategy: The bucket strategy.
+//      index_t rho: Lightest edges rank used as radius, by the radius strategy.
+// Output:
+//      1 --> Bucket strategy set successfully.
+//      0 --> Memory allocation failed.
+int dstep_context_strategy(struct dstep_context *context, enum dstep_strategy strategy, index_t rho)
+{
+    const struct dstep_graph *graph = context->graph;
+    index_t count = (index_t)(graph->max_weight / context->d_step) + 2;
+
+    context->strategy = strategy;
+    context->bucket_width = context->d_step;
+    context->width = 1;
+    free(context->radii);
+    context->radii = NULL;
+    if (strategy != DSTEP_STRATEGY_FIXED) {
+        context->bucket_width = context->d_step / DSTEP_PHASE_SPLIT;
+        context->width = DSTEP_PHASE_SPLIT;
+        count = (index_t)(graph->max_weight / context->bucket_width) + 2 + DSTEP_PHASE_BUCKETS;
+    }
+    dstep_buckets_free(&context->buckets);
+    if (!dstep_buckets_initialize(&context->buckets, count, graph->nodes_count)) {
+        return 0;
+    }
+    if (strategy != DSTEP_STRATEGY_RADIUS) {
+        return 1;
+    }
+    if (rho < 1) {
+        rho = 1;
+    }
+    context->radii = (weight_t*)malloc((graph->nodes_count > 0 ? graph->nodes_count : 1) * sizeof(weight_t));
+    weight_t *lightest = (weight_t*)malloc(rho * sizeof(weight_t));
+    if (context->radii == NULL || lightest == NULL) {
+        free(lightest);
+        return 0;
+    }
+    for (index_t i = 0; i < graph->nodes_count; i++) {
+        // Keep the node rho lightest edges sorted, by insertion.
+        index_t kept = 0;
+        for (index_t k = graph->offsets[i]; k < graph->offsets[i + 1]; k++) {
+            weight_t weight = graph->weights[k];
+            if (kept == rho && weight >= lightest[rho - 1]) {
+                continue;
+            }
+            index_t pos = kept < rho ? kept++ : rho - 1;
+            while (pos > 0 && lightest[pos - 1] > weight) {
+                lightest[pos] = lightest[pos - 1];
+                pos --;
+            }
+            lightest[pos] = weight;
+        }
+        context->radii[i] = kept > 0 ? lightest[kept - 1] : 0;
+    }
+    free(lightest);
+    return 1;
+}
+
+// This function queues a node in the bucket of a distance. Buckets are
+// cyclic, so the bucket is clamped to the window starting at the first
+// bucket of the phase. Queuing a node already scanned in the phase counts
+// as a re-insertion.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t node: The node.
+//      weight_t distance: The distance.
+//      index_t current: The first bucket of the phase.
+// Output:
+//      index_t --> The bucket, not wrapped around.
+static index_t enqueue(struct dstep_context *context, index_t node, weight_t distance, index_t current)
+{
+    struct dstep_buckets *buckets = &context->buckets;
+    double delta = floor(distance / context->bucket_width);
+    index_t bucket = current;
+    if (delta > current + buckets->count - 1) {
+        bucket = current + buckets->count - 1;
+    } else if (delta > current) {
+        bucket = (index_t)delta;
+    }
+    if (buckets->node_buckets[node] == bucket % buckets->count) {
+        return bucket;
+    }
+    if (buckets->node_buckets[node] != -1) {
+        dstep_buckets_remove(buckets, node);
+    } else if (context->scanned[node] == context->phases) {
+        context->phase_reinsertions ++;
+    }
+    dstep_buckets_insert(buckets, node, bucket % buckets->count);
+    return bucket;
+}
+
+// This function starts a phase at its first bucket, returning the bucket
+// after its last one, as chosen by the bucket strategy. Phases span at most
+// buckets count - 1 buckets, so nodes clamped by enqueue stay out of them.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t current: The first bucket of the phase, not empty.
+//      const weight_t *keys: Queued distance of each node.
+// Output:
+//      index_t --> The bucket after the last one of the phase.
+static index_t start_phase(struct dstep_context *context, index_t current, const weight_t *keys)
+{
+    struct dstep_buckets *buckets = &context->buckets;
+    index_t width = 1;
+
+    context->phase_scans = 0;
+    context->phase_reinsertions = 0;
+    context->phases ++;
+    if (context->strategy == DSTEP_STRATEGY_ADAPTIVE) {
+        width = context->width;
+    } else if (context->strategy == DSTEP_STRATEGY_RADIUS) {
+        // The phase ends at the lowest distance plus radius of its first bucket nodes.
+        double end = INFINITY;
+        for (index_t node = buckets->heads[current % buckets->count]; node != -1; node = buckets->next[node]) {
+            double reach = (double)keys[node] + (double)context->radii[node];
+            end = reach < end ? reach : end;
+        }
+        double last = floor(end / context->bucket_width);
+        width = last - current + 1 < buckets->count - 1 ? (index_t)(last - current + 1) : buckets->count - 1;
+    }
+    if (width > buckets->count - 1) {
+        width = buckets->count - 1;
+    }
+    return current + (width > 1 ? width : 1);
+}
+
+// This function ends a phase. The adaptive strategy halves the phase width
+// when more than a quarter of the phase scans were re-insertions, and
+// doubles it when the phase scanned fewer nodes than the frontier target.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+static void end_phase(struct dstep_context *context)
+{
+    context->scans += context->phase_scans;
+    if (context->strategy != DSTEP_STRATEGY_ADAPTIVE) {
+        return;
+    }
+    if (context->phase_reinsertions * 4 > context->phase_scans) {
+        context->width = context->width > 1 ? context->width / 2 : 1;
+    } else if (context->phase_scans < DSTEP_FRONTIER_TARGET && context->width < DSTEP_PHASE_BUCKETS) {
+        context->width *= 2;
+    }
+}
+
+// This function lowers a node tentative distance and queues it, in the
+// bucket of the new distance.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t node: The node.
+//      weight_t distance: The distance found.
+//      index_t current: The first bucket of the phase.
+// Output:
+//      index_t --> The bucket, not wrapped around, or -1 if not improved.
+static index_t relax(struct dstep_context *context, index_t node, weight_t distance, index_t current)
+{
+    if (distance >= context->distances[node]) {
+        return -1;
+    }
+    context->distances[node] = distance;
+    return enqueue(context, node, distance, current);
+}
+
+// This function scans the queued nodes in phases, until all buckets are
+// empty. Each phase scans the buckets chosen by the bucket strategy in order,
+// until they are all empty, and a node is queued again whenever its distance
+// improves. Nodes marked exact keep their distance and are never relaxed.
+// Inputs:
+//      struct dstep_context *context: The solver context, with queued nodes.
+//      const char *exact: Exact nodes marks, NULL if none.
+//      index_t current: The bucket to start from, at most the lowest queued one.
+static void scan_phases(struct dstep_context *context, const char *exact, index_t current)
+{
+    const struct dstep_graph *graph = context->graph;
+    struct dstep_buckets *buckets = &context->buckets;
+    weight_t *distances = context->distances;
+    index_t k, node;
+
+    while (buckets->queued > 0) {
+        while (buckets->heads[current % buckets->count] == -1) {
+            current ++;
+        }
+        index_t end = start_phase(context, current, distances);
+        index_t scanning = current;
+        while (scanning < end) {
+            index_t bucket = scanning % buckets->count;
+            if (buckets->heads[bucket] == -1) {
+                scanning ++;
+                continue;
+            }
+            node = buckets->heads[bucket];
+            dstep_buckets_remove(buckets, node);
+            context->scanned[node] = context->phases;
+            context->phase_scans ++;
+            for (k = graph->offsets[node]; k < graph->offsets[node + 1]; k++) {
+                if (exact != NULL && exact[graph->targets[k]]) {
+                    continue;
+                }
+                index_t queued = relax(context, graph->targets[k], distances[node] + graph->weights[k], current);
+                scanning = queued != -1 && queued < scanning ? queued : scanning;
+            }
+        }
+        end_phase(context);
+        current = end;
+    }
+}
+
+// This function finds the shortest path distances from a source node to all
+// other nodes, scanning phases from the source node. Only the source
+// component entries are stored and reset, so the work is proportional to it.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t source: The source node.
+//      weight_t *row: Distances row to store found distances, NO_WEIGHT
+//                     for unreachable nodes and the source node itself.
+//                     Only the source component entries are stored.
+void dstep_sssp(struct dstep_context *context, index_t source, weight_t *row)
+{
+    weight_t *distances = context->distances;
+    index_t count;
+    const index_t *nodes = reachable_nodes(context->graph, source, &count);
+
+    relax(context, source, 0, 0);
+    scan_phases(context, NULL, 0);
+    for (index_t k = 0; k < count; k++) {
+        index_t i = nodes != NULL ? nodes[k] : k;
+        row[i] = (i == source || distances[i] == WEIGHT_INFINITY) ? NO_WEIGHT : distances[i];
+        distances[i] = WEIGHT_INFINITY;
+    }
+}
+
+// This function queues a node whose distances improved, in the bucket of
+// its lowest improved distance. Distances of different sources may lie far
+// apart, and scanning a node earlier than its bucket is only extra work.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t node: The node.
+//      weight_t distance: The lowest improved distance.
+//      index_t current: The first bucket of the phase.
+// Output:
+//      index_t --> The bucket, not wrapped around, or -1 if not queued.
+static index_t batch_enqueue(struct dstep_context *context, index_t node, weight_t distance, index_t current)
+{
+    if (distance >= context->pending[node]) {
+        return -1;
+    }
+    context->pending[node] = distance;
+    return enqueue(context, node, distance, current);
+}
+
+// This function finds the shortest path distances from up to BATCH_SIZE
+// consecutive source nodes at once. Distances of all sources are stored per
+// node as a contiguous vector, a node is queued by its lowest improved distance
+// and, when scanned, its edges relax the distances of all sources. Only the
+// components of the batch sources are reset and stored, each once.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t first_source: The first source node of the batch.
+//      index_t size: The batch sources count, at most BATCH_SIZE.
+//      weight_t **rows: Distances rows to store found distances, one per source.
+static void batch_sssp(struct dstep_context *context, index_t first_source, index_t size, weight_t **rows)
+{
+    const struct dstep_graph *graph = context->graph;
+    struct dstep_buckets *buckets = &context->buckets;
+    index_t i, j, k, b, node, count;
+    index_t current = 0;
+    const index_t *nodes;
+
+    for (k = 0; k < size; k++) {
+        int seen = 0;
+        for (j = 0; j < k; j++) {
+            seen |= same_component(graph, first_source + j, first_source + k);
+        }
+        if (seen) {
+            continue;
+        }
+        nodes = reachable_nodes(graph, first_source + k, &count);
+        for (j = 0; j < count; j++) {
+            i = nodes != NULL ? nodes[j] : j;
+            context->pending[i] = WEIGHT_INFINITY;
+            for (b = 0; b < BATCH_SIZE; b++) {
+                context->batch_distances[(size_t)i * BATCH_SIZE + b] = WEIGHT_INFINITY;
+            }
+        }
+    }
+    for (k = 0; k < size; k++) {
+        context->batch_distances[(size_t)(first_source + k) * BATCH_SIZE + k] = 0;
+        batch_enqueue(context, first_source + k, 0, current);
+    }
+    while (buckets->queued > 0) {
+        while (buckets->heads[current % buckets->count] == -1) {
+            current ++;
+        }
+        index_t end = start_phase(context, current, context->pending);
+        index_t scanning = current;
+        while (scanning < end) {
+            index_t bucket = scanning % buckets->count;
+            if (buckets->heads[bucket] == -1) {
+                scanning ++;
+                continue;
+            }
+            node = buckets->heads[bucket];
+            dstep_buckets_remove(buckets, node);
+            context->pending[node] = WEIGHT_INFINITY;
+            context->scanned[node] = context->phases;
+            context->phase_scans ++;
+            weight_t *node_distances = context->batch_distances + (size_t)node * BATCH_SIZE;
+            for (i = graph->offsets[node]; i < graph->offsets[node + 1]; i++) {
+                weight_t *target_distances = context->batch_distances + (size_t)graph->targets[i] * BATCH_SIZE;
+                weight_t weight = graph->weights[i];
+                weight_t lowest = WEIGHT_INFINITY;
+                // Branch-free over sources, so the compiler vectorizes it.
+                for (k = 0; k < BATCH_SIZE; k++) {
+                    weight_t found = node_distances[k] + weight;
+                    weight_t saved = target_distances[k];
+                    target_distances[k] = found < saved ? found : saved;
+                    lowest = (found < saved && found < lowest) ? found : lowest;
+                }
+                if (lowest != WEIGHT_INFINITY) {
+                    index_t queued = batch_enqueue(context, graph->targets[i], lowest, current);
+                    scanning = queued != -1 && queued < scanning ? queued : scanning;
+                }
+            }
+        }
+        end_phase(context);
+        current = end;
+    }
+
+    for (k = 0; k < size; k++) {
+        weight_t *row = rows[k];
+        nodes = reachable_nodes(graph, first_source + k, &count);
+        for (j = 0; j < count; j++) {
+            i = nodes != NULL ? nodes[j] : j;
+            weight_t distance = context->batch_distances[(size_t)i * BATCH_SIZE + k];
+            row[i] = (i == first_source + k || distance == WEIGHT_INFINITY) ? NO_WEIGHT : distance;
+        }
+    }
+}
+
+// This function finds the shortest path distances from consecutive source
+// nodes to all other nodes, BATCH_SIZE sources per Graph traversal.
+// Inputs:
+//      struct dstep_context *context: The solver context.
+//      index_t first_source: The first source node.
+//      index_t count: The source nodes count.
+//      weight_t **rows: Distances rows to store found distances, one per
+//                       source, NO_WEIGHT for unreachable nodes and the
+//                       source node itself. Only the source component
+//                       entries are stored.
+void dstep_apsp(struct dstep_context *context, index_t first_source, index_t count, weight_t **rows)
+{
+    for (index_t done = 0; done < count; done += BATCH_SIZE) {
+        index_t size = count - done < BATCH_SIZE ? count - done : BATCH_SIZE;
+        batch_sssp(context, first_source + done, size, rows + done);
+    }
+}
+
+// This function checks whether all Graph weights, multiplied by a
+// scale, are integers.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      double scale: The scale.
+// Output:
+//      1 --> All scaled weights are integers.
+//      0 --> Some scaled weight has a fractional part.
+static int is_integral_scale(const struct dstep_graph *graph, double scale)
+{
+    for (index_t k = 0; k < graph->offsets[graph->nodes_count]; k++) {
+        double scaled = (double)graph->weights[k] * scale;
+        if (fabs(scaled - nearbyint(scaled)) > RADIX_TOLERANCE * fmax(1.0, scaled)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// This function checks a radix engine scale, or finds the lowest power of
+// ten up to DSTEP_RADIX_DIGITS digits when none is given. Rounding scaled
+// weights would silently change distances, so a valid scale makes all weights
+// integers, and D at least one.
+// Inputs:
+//      const struct dstep_graph *graph: The Graph.
+//      double d_step: The D value.
+//      double scale: The scale to check, 0 to find one.
+// Output:
+//      double --> The valid scale, 0 if none.
+double dstep_radix_scale(const struct dstep_graph *graph, double d_step, double scale)
+{
+    if (scale == 0) {
+        double power = 1;
+        for (int digits = 0; digits <= DSTEP_RADIX_DIGITS; digits++, power *= 10) {
+            if ((dstep_radix_t)(d_step * power) > 0 && is_integral_scale(graph, power)) {
+                return power;
+            }
+        }
+        return 0;
+    }
+    return (dstep_radix_t)(d_step * scale) > 0 && is_integral_scale(graph, scale) ? scale : 0;
+}
+
+// This function initializes a radix engine Graph, by quantizing the Graph
+// weights to integers using a valid scale, see dstep_radix_scale. D value
+// is rounded down to a power of two, so bucket indexes are computed by shifts.
+// Inputs:
+//      struct dstep_radix_graph *radix: The radix engine Graph.
+//      const struct dstep_graph *graph: The Graph.
+//      double d_step: The D value.
+//      double scale: The scale.
+// Output:
+//      1 --> Radix engine Graph initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_radix_graph_initialize(struct dstep_radix_graph *radix, const struct dstep_graph *graph, double d_step, double scale)
+{
+    index_t i, k, pos, light_pos, nodes_count = graph->nodes_count;
+    dstep_radix_t weight, max_weight = 0;
+    size_t edges = graph->offsets[nodes_count];
+    dstep_radix_t quantum = (dstep_radix_t)(d_step * scale);
+
+    radix->graph = graph;
+    radix->scale = scale;
+    radix->shift = 0;
+    while (((dstep_radix_t)2 << radix->shift) <= quantum) {
+        radix->shift ++;
+    }
+    radix->offsets = (index_t*)malloc((nodes_count + 1) * sizeof(index_t));
+    radix->light_ends = (index_t*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(index_t));
+    radix->targets = (index_t*)malloc((edges > 0 ? edges : 1) * sizeof(index_t));
+    radix->weights = (dstep_radix_t*)malloc((edges > 0 ? edges : 1) * sizeof(dstep_radix_t));
+    if (radix->offsets == NULL || radix->light_ends == NULL || radix->targets == NULL || radix->weights == NULL) {
+        dstep_radix_graph_free(radix);
+        return 0;
+    }
+    for (i = 0; i <= nodes_count; i++) {
+        radix->offsets[i] = graph->offsets[i];
+    }
+    for (i = 0; i < nodes_count; i++) {
+        // Light edges are placed from the row start, heavy ones from the row end.
+        light_pos = radix->offsets[i];
+        pos = radix->offsets[i + 1];
+        for (k = graph->offsets[i]; k < graph->offsets[i + 1]; k++) {
+            weight = (dstep_radix_t)llround((double)graph->weights[k] * scale);
+            if (weight > max_weight) {
+                max_weight = weight;
+            }
+            if ((weight >> radix->shift) == 0 || weight == ((dstep_radix_t)1 << radix->shift)) {
+                radix->targets[light_pos] = graph->targets[k];
+                radix->weights[light_pos] = weight;
+                light_pos ++;
+            } else {
+                pos --;
+                radix->targets[pos] = graph->targets[k];
+                radix->weights[pos] = weight;
+            }
+        }
+        radix->light_ends[i] = light_pos;
+    }
+    radix->buckets_count = (index_t)(max_weight >> radix->shift) + 2;
+    return 1;
+}
+
+// This function frees allocated memory of a radix engine Graph.
+// Inputs:
+//      struct dstep_radix_graph *radix: The radix engine Graph.
+void dstep_radix_graph_free(struct dstep_radix_graph *radix)
+{
+    free(radix->offsets);
+    free(radix->light_ends);
+    free(radix->targets);
+    free(radix->weights);
+    radix->offsets = NULL;
+    radix->light_ends = NULL;
+    radix->targets = NULL;
+    radix->weights = NULL;
+}
+
+// This function initializes a radix engine, all nodes unsettled.
+// Inputs:
+//      struct dstep_radix_engine *engine: The radix engine.
+//      const struct dstep_radix_graph *radix: The radix engine Graph, shared by engines.
+// Output:
+//      1 --> Radix engine initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_radix_initialize(struct dstep_radix_engine *engine, const struct dstep_radix_graph *radix)
+{
+    index_t nodes_count = radix->graph->nodes_count;
+    size_t count = nodes_count > 0 ? nodes_count : 1;
+
+    memset(engine, 0, sizeof(struct dstep_radix_engine));
+    engine->radix = radix;
+    engine->distances = (dstep_radix_t*)malloc(count * sizeof(dstep_radix_t));
+    engine->frontier = (index_t*)malloc(count * sizeof(index_t));
+    engine->settled = (index_t*)malloc(count * sizeof(index_t));
+    engine->is_settled = (char*)calloc(count, sizeof(char));
+    if (engine->distances == NULL || engine->frontier == NULL || engine->settled == NULL || engine->is_settled == NULL
+        || !dstep_buckets_initialize(&engine->buckets, radix->buckets_count, nodes_count)) {
+        dstep_radix_free(engine);
+        return 0;
+    }
+    return 1;
+}
+
+// This function frees allocated memory of a radix engine.
+// Inputs:
+//      struct dstep_radix_engine *engine: The radix engine.
+void dstep_radix_free(struct dstep_radix_engine *engine)
+{
+    free(engine->distances);
+    free(engine->frontier);
+    free(engine->settled);
+    free(engine->is_settled);
+    dstep_buckets_free(&engine->buckets);
+    engine->distances = NULL;
+    engine->frontier = NULL;
+    engine->settled = NULL;
+    engine->is_settled = NULL;
+}
+
+// This function relaxes a node: if the given distance is shorter than
+// the tentative one, the node is moved to the bucket of the new distance.
+// Inputs:
+//      struct dstep_radix_engine *engine: The radix engine.
+//      index_t node: The node.
+//      dstep_radix_t distance: The distance found.
+static void radix_relax(struct dstep_radix_engine *engine, index_t node, dstep_radix_t distance)
+{
+    if (distance >= engine->distances[node]) {
+        return;
+    }
+    engine->distances[node] = distance;
+    if (engine->buckets.node_buckets[node] != -1) {
+        dstep_buckets_remove(&engine->buckets, node);
+    }
+    dstep_buckets_insert(&engine->buckets, node, (index_t)((distance >> engine->radix->shift) % engine->radix->buckets_count));
+}
+
+// This function implements the D-Stepping algorithm over integer distances,
+// using the radix engine, and finds the shortest path distances from a
+// source node to all other nodes. Buckets are processed in increasing order,
+// light edges are relaxed until the current bucket stays empty, then heavy
+// edges of all nodes settled in it are relaxed.
+// Inputs:
+//      struct dstep_radix_engine *engine: The radix engine.
+//      index_t source: The source node.
+//      weight_t *row: Distances row to store found distances, NO_WEIGHT
+//                     for unreachable nodes and the source node itself.
+//                     Only the source component entries are stored.
+void dstep_radix_sssp(struct dstep_radix_engine *engine, index_t source, weight_t *row)
+{
+    const struct dstep_radix_graph *radix = engine->radix;
+    index_t i, k, node, frontier_count, settled_count, count;
+    index_t current = 0;
+    const index_t *nodes = reachable_nodes(radix->graph, source, &count);
+
+    for (k = 0; k < count; k++) {
+        engine->distances[nodes != NULL ? nodes[k] : k] = DSTEP_RADIX_INFINITY;
+    }
+    radix_relax(engine, source, 0);
+    while (engine->buckets.queued > 0) {
+        index_t bucket = current % radix->buckets_count;
+        settled_count = 0;
+        while (engine->buckets.heads[bucket] != -1) {
+            // Remove all nodes of the current bucket.
+            frontier_count = 0;
+            while (engine->buckets.heads[bucket] != -1) {
+                node = engine->buckets.heads[bucket];
+                dstep_buckets_remove(&engine->buckets, node);
+                engine->frontier[frontier_count++] = node;
+                if (!engine->is_settled[node]) {
+                    engine->is_settled[node] = 1;
+                    engine->settled[settled_count++] = node;
+                }
+            }
+            // Relax Light edges, which may refill the current bucket.
+            for (i = 0; i < frontier_count; i++) {
+                node = engine->frontier[i];
+                for (k = radix->offsets[node]; k < radix->light_ends[node]; k++) {
+                    radix_relax(engine, radix->targets[k], engine->distances[node] + radix->weights[k]);
+                }
+            }
+        }
+        // Relax Heavy edges of all settled nodes.
+        for (i = 0; i < settled_count; i++) {
+            node = engine->settled[i];
+            engine->is_settled[node] = 0;
+            for (k = radix->light_ends[node]; k < radix->offsets[node + 1]; k++) {
+                radix_relax(engine, radix->targets[k], engine->distances[node] + radix->weights[k]);
+            }
+        }
+        current ++;
+    }
+
+    for (k = 0; k < count; k++) {
+        i = nodes != NULL ? nodes[k] : k;
+        if (i == source || engine->distances[i] == DSTEP_RADIX_INFINITY) {
+            row[i] = NO_WEIGHT;
+        } else {
+            row[i] = WEIGHT_FROM_DOUBLE((double)engine->distances[i] / radix->scale);
+        }
+    }
+}
+
+// This function initializes a dense engine Graph, by copying the Graph
+// edges to a padded, aligned matrix where missing edges are infinite.
+// Inputs:
+//      struct dstep_dense_graph *dense: The dense engine Graph.
+//      const struct dstep_graph *graph: The Graph.
+// Output:
+//      1 --> Dense engine Graph initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_dense_graph_initialize(struct dstep_dense_graph *dense, const struct dstep_graph *graph)
+{
+    index_t i, j, k, nodes_count = graph->nodes_count;
+
+    dense->graph = graph;
+    dense->stride = (nodes_count + DENSE_WIDTH - 1) / DENSE_WIDTH * DENSE_WIDTH;
+    dense->weights = (weight_t*)aligned_alloc(32, sizeof(weight_t) * (dense->stride > 0 ? dense->stride : DENSE_WIDTH) * (nodes_count > 0 ? nodes_count : 1));
+    if (dense->weights == NULL) {
+        return 0;
+    }
+    for (i = 0; i < nodes_count; i++) {
+        weight_t *row = dense->weights + (size_t)dense->stride * i;
+        for (j = 0; j < dense->stride; j++) {
+            row[j] = WEIGHT_INFINITY;
+        }
+        for (k = graph->offsets[i]; k < graph->offsets[i + 1]; k++) {
+            row[graph->targets[k]] = graph->weights[k];
+        }
+    }
+    return 1;
+}
+
+// This function frees allocated memory of a dense engine Graph.
+// Inputs:
+//      struct dstep_dense_graph *dense: The dense engine Graph.
+void dstep_dense_graph_free(struct dstep_dense_graph *dense)
+{
+    free(dense->weights);
+    dense->weights = NULL;
+}
+
+// This function initializes a dense engine.
+// Inputs:
+//      struct dstep_dense_engine *engine: The dense engine.
+//      const struct dstep_dense_graph *dense: The dense engine Graph, shared by engines.
+//      double d_step: The D value, positive.
+// Output:
+//      1 --> Dense engine initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_dense_initialize(struct dstep_dense_engine *engine, const struct dstep_dense_graph *dense, double d_step)
+{
+    index_t stride = dense->stride > 0 ? dense->stride : DENSE_WIDTH;
+
+    engine->dense = dense;
+    engine->d_step = d_step;
+    engine->distances = (weight_t*)aligned_alloc(32, sizeof(weight_t) * stride);
+    engine->state = (unsigned char*)malloc(stride * sizeof(unsigned char));
+    if (engine->distances == NULL || engine->state == NULL) {
+        dstep_dense_free(engine);
+        return 0;
+    }
+    return 1;
+}
+
+// This function frees allocated memory of a dense engine.
+// Inputs:
+//      struct dstep_dense_engine *engine: The dense engine.
+void dstep_dense_free(struct dstep_dense_engine *engine)
+{
+    free(engine->distances);
+    free(engine->state);
+    engine->distances = NULL;
+    engine->state = NULL;
+}
+
+// This function relaxes all neighbors of a node with a single min-plus
+// row update: distances[j] = min(distances[j], distances[node] + weights[node][j]).
+// Improved neighbors are marked pending, unless already settled.
+// Inputs:
+//      struct dstep_dense_engine *engine: The dense engine.
+//      index_t node: The node.
+static void dense_relax_row(struct dstep_dense_engine *engine, index_t node)
+{
+    const struct dstep_dense_graph *dense = engine->dense;
+    const weight_t *row = dense->weights + (size_t)dense->stride * node;
+    weight_t *distances = engine->distances;
+    unsigned char *state = engine->state;
+    index_t j;
+#if defined(__AVX2__) && defined(WEIGHT_FLOAT)
+    __m256 base = _mm256_set1_ps(distances[node]);
+    for (j = 0; j < dense->stride; j += DENSE_WIDTH) {
+        __m256 current = _mm256_load_ps(distances + j);
+        __m256 found = _mm256_add_ps(base, _mm256_load_ps(row + j));
+        int improved = _mm256_movemask_ps(_mm256_cmp_ps(found, current, _CMP_LT_OQ));
+        if (improved) {
+            _mm256_store_ps(distances + j, _mm256_min_ps(found, current));
+            for (; improved; improved &= improved - 1) {
+                index_t k = j + __builtin_ctz(improved);
+                if (state[k] == DENSE_CLEAN) {
+                    state[k] = DENSE_PENDING;
+                }
+            }
+        }
+    }
+#elif defined(__AVX2__) && defined(WEIGHT_UINT32)
+    __m256i base = _mm256_set1_epi32((int)distances[node]);
+    for (j = 0; j < dense->stride; j += DENSE_WIDTH) {
+        __m256i current = _mm256_load_si256((__m256i*)(distances + j));
+        __m256i found = _mm256_add_epi32(base, _mm256_load_si256((const __m256i*)(row + j)));
+        __m256i minimum = _mm256_min_epu32(found, current);
+        int improved = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(minimum, current))) & 0xFF;
+        if (improved) {
+            _mm256_store_si256((__m256i*)(distances + j), minimum);
+            for (; improved; improved &= improved - 1) {
+                index_t k = j + __builtin_ctz(improved);
+                if (state[k] == DENSE_CLEAN) {
+                    state[k] = DENSE_PENDING;
+                }
+            }
+        }
+    }
+#elif defined(__AVX2__)
+    __m256d base = _mm256_set1_pd(distances[node]);
+    for (j = 0; j < dense->stride; j += DENSE_WIDTH) {
+        __m256d current = _mm256_load_pd(distances + j);
+        __m256d found = _mm256_add_pd(base, _mm256_load_pd(row + j));
+        int improved = _mm256_movemask_pd(_mm256_cmp_pd(found, current, _CMP_LT_OQ));
+        if (improved) {
+            _mm256_store_pd(distances + j, _mm256_min_pd(found, current));
+            for (; improved; improved &= improved - 1) {
+                index_t k = j + __builtin_ctz(improved);
+                if (state[k] == DENSE_CLEAN) {
+                    state[k] = DENSE_PENDING;
+                }
+            }
+        }
+    }
+#else
+    weight_t base = distances[node];
+    for (j = 0; j < dense->stride; j++) {
+        weight_t found = base + row[j];
+        if (found < distances[j]) {
+            distances[j] = found;
+            if (state[j] == DENSE_CLEAN) {
+                state[j] = DENSE_PENDING;
+            }
+        }
+    }
+#endif
+}
+
+// This function implements the D-Stepping algorithm using the dense engine,
+// and finds the shortest path distances from a source node to all other nodes.
+// The lowest non settled bucket is found, its pending nodes rows are relaxed
+// until none is left pending, then all its nodes are settled.
+// Inputs:
+//      struct dstep_dense_engine *engine: The dense engine.
+//      index_t source: The source node.
+//      weight_t *row: Distances row to store found distances, NO_WEIGHT
+//                     for unreachable nodes and the source node itself.
+//                     Only the source component entries are stored.
+void dstep_dense_sssp(struct dstep_dense_engine *engine, index_t source, weight_t *row)
+{
+    const struct dstep_dense_graph *dense = engine->dense;
+    weight_t *distances = engine->distances;
+    unsigned char *state = engine->state;
+    index_t j, k, count;
+    const index_t *nodes = reachable_nodes(dense->graph, source, &count);
+
+    for (j = 0; j < dense->stride; j++) {
+        distances[j] = WEIGHT_INFINITY;
+        state[j] = (j < dense->graph->nodes_count) ? DENSE_CLEAN : DENSE_SETTLED;
+    }
+    distances[source] = 0;
+    state[source] = DENSE_PENDING;
+    while (1) {
+        // Find lowest non settled distance, which defines the current bucket.
+        // Only the source component is reachable, so scans are restricted to its nodes.
+        weight_t minimum = WEIGHT_INFINITY;
+        for (k = 0; k < count; k++) {
+            j = nodes != NULL ? nodes[k] : k;
+            if (state[j] != DENSE_SETTLED && distances[j] < minimum) {
+                minimum = distances[j];
+            }
+        }
+        if (minimum == WEIGHT_INFINITY) {
+            break;
+        }
+        double bucket_end = (floor(minimum / engine->d_step) + 1) * engine->d_step;
+        int pending = 1;
+        while (pending) {
+            pending = 0;
+            for (k = 0; k < count; k++) {
+                j = nodes != NULL ? nodes[k] : k;
+                if (state[j] == DENSE_PENDING && distances[j] < bucket_end) {
+                    state[j] = DENSE_CLEAN;
+                    dense_relax_row(engine, j);
+                    pending = 1;
+                }
+            }
+        }
+        for (k = 0; k < count; k++) {
+            j = nodes != NULL ? nodes[k] : k;
+            if (state[j] != DENSE_SETTLED && distances[j] < bucket_end) {
+                state[j] = DENSE_SETTLED;
+            }
+        }
+    }
+
+    for (k = 0; k < count; k++) {
+        j = nodes != NULL ? nodes[k] : k;
+        row[j] = (j == source || distances[j] == WEIGHT_INFINITY) ? NO_WEIGHT : distances[j];
+    }
+}
+
+// This function returns the position of a node pair distance in the upper triangle.
+// Inputs:
+//      index_t nodes_count: Nodes count.
+//      index_t i: First node.
+//      index_t j: Second node, greater than i.
+// Output:
+//      size_t --> Position in the upper triangle.
+static size_t triangle_position(index_t nodes_count, index_t i, index_t j)
+{
+    return (size_t)i * nodes_count - (size_t)i * (i + 1) / 2 + (j - i - 1);
+}
+
+// This function initializes a symmetric engine and its upper triangle.
+// Inputs:
+//      struct dstep_symmetric_engine *engine: The symmetric engine.
+//      const struct dstep_graph *graph: The Graph, undirected.
+//      double d_step: The D value, positive.
+// Output:
+//      1 --> Symmetric engine initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_symmetric_initialize(struct dstep_symmetric_engine *engine, const struct dstep_graph *graph, double d_step)
+{
+    size_t nodes_count = graph->nodes_count;
+
+    engine->triangle = (weight_t*)malloc(sizeof(weight_t) * nodes_count * (nodes_count - 1) / 2 + 1);
+    engine->exact = (char*)malloc(nodes_count > 0 ? nodes_count : 1);
+    if (engine->triangle == NULL || engine->exact == NULL || !dstep_context_initialize(&engine->context, graph, d_step)) {
+        free(engine->triangle);
+        free(engine->exact);
+        engine->triangle = NULL;
+        engine->exact = NULL;
+        return 0;
+    }
+    // Searches only store distances within their component.
+    for (size_t i = 0; i < nodes_count * (nodes_count - 1) / 2; i++) {
+        engine->triangle[i] = NO_WEIGHT;
+    }
+    return 1;
+}
+
+// This function frees allocated memory of a symmetric engine.
+// Inputs:
+//      struct dstep_symmetric_engine *engine: The symmetric engine.
+void dstep_symmetric_free(struct dstep_symmetric_engine *engine)
+{
+    free(engine->triangle);
+    free(engine->exact);
+    engine->triangle = NULL;
+    engine->exact = NULL;
+    dstep_context_free(&engine->context);
+}
+
+// This function finds the shortest path distances from a source node to all
+// nodes with greater ids, filling its upper triangle row. As the Graph is
+// undirected, distances to lower ids nodes are already known from their rows:
+// they are exact and never relaxed. Only nodes with greater ids are found, and
+// only the source component nodes are visited. Sources must be found in
+// ascending ids order.
+// Inputs:
+//      struct dstep_symmetric_engine *engine: The symmetric engine.
+//      index_t source: The source node.
+void dstep_symmetric_sssp(struct dstep_symmetric_engine *engine, index_t source)
+{
+    struct dstep_context *context = &engine->context;
+    index_t nodes_count = context->graph->nodes_count;
+    weight_t *distances = context->distances;
+    weight_t *triangle = engine->triangle;
+    index_t i, k, count;
+    const index_t *nodes = reachable_nodes(context->graph, source, &count);
+
+    for (k = 0; k < count; k++) {
+        i = nodes != NULL ? nodes[k] : k;
+        distances[i] = WEIGHT_INFINITY;
+        engine->exact[i] = 0;
+    }
+    // Component nodes are in ascending ids order.
+    for (k = 0; k < count && (i = nodes != NULL ? nodes[k] : k) < source; k++) {
+        weight_t distance = triangle[triangle_position(nodes_count, i, source)];
+        if (distance != NO_WEIGHT) {
+            relax(context, i, distance, 0);
+            engine->exact[i] = 1;
+        }
+    }
+    index_t greater = k + 1; // First component node after the source.
+    relax(context, source, 0, 0);
+    engine->exact[source] = 1;
+    scan_phases(context, engine->exact, 0);
+
+    for (k = greater; k < count; k++) {
+        i = nodes != NULL ? nodes[k] : k;
+        triangle[triangle_position(nodes_count, source, i)] = distances[i] == WEIGHT_INFINITY ? NO_WEIGHT : distances[i];
+    }
+}
+
+// This function returns the distance of a node pair found by a symmetric engine.
+// Inputs:
+//      const struct dstep_symmetric_engine *engine: The symmetric engine.
+//      index_t i: First node.
+//      index_t j: Second node.
+// Output:
+//      weight_t --> The distance, NO_WEIGHT if unreachable or i is j.
+weight_t dstep_symmetric_distance(const struct dstep_symmetric_engine *engine, index_t i, index_t j)
+{
+    index_t nodes_count = engine->context.graph->nodes_count;
+    if (i == j) {
+        return NO_WEIGHT;
+    }
+    return engine->triangle[i < j ? triangle_position(nodes_count, i, j) : triangle_position(nodes_count, j, i)];
+}
+
+// This function initializes a point-to-point engine, with all distances
+// infinite and all buckets empty.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+//      const struct dstep_graph *graph: The Graph.
+//      double d_step: The D value, positive.
+// Output:
+//      1 --> Point-to-point engine initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_pair_initialize(struct dstep_pair_engine *pair, const struct dstep_graph *graph, double d_step)
+{
+    size_t count = graph->nodes_count > 0 ? graph->nodes_count : 1;
+
+    memset(pair, 0, sizeof(struct dstep_pair_engine));
+    pair->graph = graph;
+    pair->forward.scanned = (char*)calloc(count, sizeof(char));
+    pair->backward.scanned = (char*)calloc(count, sizeof(char));
+    pair->touched = (index_t*)malloc(count * sizeof(index_t));
+    pair->results = (struct dstep_bounded_result*)malloc(count * sizeof(struct dstep_bounded_result));
+    if (pair->forward.scanned == NULL || pair->backward.scanned == NULL || pair->touched == NULL || pair->results == NULL
+        || !dstep_context_initialize(&pair->forward.context, graph, d_step)
+        || !dstep_context_initialize(&pair->backward.context, graph, d_step)) {
+        dstep_pair_free(pair);
+        return 0;
+    }
+    return 1;
+}
+
+// This function frees allocated memory of a point-to-point engine.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+void dstep_pair_free(struct dstep_pair_engine *pair)
+{
+    free(pair->forward.scanned);
+    free(pair->backward.scanned);
+    free(pair->touched);
+    free(pair->results);
+    pair->forward.scanned = NULL;
+    pair->backward.scanned = NULL;
+    pair->touched = NULL;
+    pair->results = NULL;
+    dstep_context_free(&pair->forward.context);
+    dstep_context_free(&pair->backward.context);
+}
+
+// This function lowers a node tentative distance of a search and queues it,
+// recording the node as touched the first time any search reaches it.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+//      struct dstep_pair_search *search: The search.
+//      index_t node: The node.
+//      weight_t distance: The distance found.
+static void pair_relax(struct dstep_pair_engine *pair, struct dstep_pair_search *search, index_t node, weight_t distance)
+{
+    if (distance >= search->context.distances[node]) {
+        return;
+    }
+    if (pair->forward.context.distances[node] == WEIGHT_INFINITY && pair->backward.context.distances[node] == WEIGHT_INFINITY) {
+        pair->touched[pair->touched_count++] = node;
+    }
+    relax(&search->context, node, distance, search->current);
+}
+
+// This function scans the current bucket of a search until it is empty,
+// then moves to the next one. When the other direction search is given,
+// each scanned edge reaching a node it touched lowers the best meeting distance.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+//      struct dstep_pair_search *search: The search.
+//      struct dstep_pair_search *other: The other direction search, or NULL.
+//      weight_t *meeting: The best meeting distance found, unused without other search.
+static void pair_scan_bucket(struct dstep_pair_engine *pair, struct dstep_pair_search *search, struct dstep_pair_search *other, weight_t *meeting)
+{
+    const struct dstep_graph *graph = pair->graph;
+    struct dstep_buckets *buckets = &search->context.buckets;
+    weight_t *distances = search->context.distances;
+    index_t bucket = search->current % buckets->count;
+
+    while (buckets->heads[bucket] != -1) {
+        index_t node = buckets->heads[bucket];
+        dstep_buckets_remove(buckets, node);
+        if (!search->scanned[node]) {
+            search->scanned[node] = 1;
+            search->scanned_count ++;
+        }
+        for (index_t k = graph->offsets[node]; k < graph->offsets[node + 1]; k++) {
+            index_t target = graph->targets[k];
+            pair_relax(pair, search, target, distances[node] + graph->weights[k]);
+            if (other != NULL && other->context.distances[target] != WEIGHT_INFINITY) {
+                weight_t found = distances[node] + graph->weights[k] + other->context.distances[target];
+                if (found < *meeting) {
+                    *meeting = found;
+                }
+            }
+        }
+    }
+    search->current ++;
+}
+
+// This function returns a lower bound of the distances a search has
+// not settled yet: every bucket before the current one is scanned.
+// Inputs:
+//      const struct dstep_pair_search *search: The search.
+// Output:
+//      double --> The lower bound, infinite if the search is exhausted.
+static double pair_lower_bound(const struct dstep_pair_search *search)
+{
+    return search->context.buckets.queued == 0 ? INFINITY : search->current * search->context.bucket_width;
+}
+
+// This function resets the state of touched nodes, emptying buckets,
+// so the point-to-point engine is ready for the next search.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+static void pair_reset(struct dstep_pair_engine *pair)
+{
+    struct dstep_pair_search *searches[2] = { &pair->forward, &pair->backward };
+
+    for (index_t i = 0; i < pair->touched_count; i++) {
+        index_t node = pair->touched[i];
+        for (int s = 0; s < 2; s++) {
+            if (searches[s]->context.buckets.node_buckets[node] != -1) {
+                dstep_buckets_remove(&searches[s]->context.buckets, node);
+            }
+            searches[s]->context.distances[node] = WEIGHT_INFINITY;
+            searches[s]->scanned[node] = 0;
+        }
+    }
+    pair->forward.scanned_count = 0;
+    pair->backward.scanned_count = 0;
+    pair->touched_count = 0;
+}
+
+// This function finds the shortest path distance from a source node to a
+// target node, scanning buckets in order and stopping as soon as the target
+// is settled: once a bucket is scanned, all distances below its end are final.
+// The bidirectional variant also searches from the target node, as the Graph
+// is undirected, always advancing the direction with the lower bound, and
+// stops when the bounds of both directions together reach the best meeting
+// distance. Touched nodes are reset before returning.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+//      index_t source: The source node.
+//      index_t target: The target node.
+//      int bidirectional: 1 to search from both nodes, 0 from the source node only.
+// Output:
+//      weight_t --> The distance, NO_WEIGHT if unreachable or source is target.
+weight_t dstep_pair_distance(struct dstep_pair_engine *pair, index_t source, index_t target, int bidirectional)
+{
+    struct dstep_pair_search *forward = &pair->forward;
+    struct dstep_pair_search *backward = &pair->backward;
+    weight_t meeting = WEIGHT_INFINITY;
+
+    if (source == target) {
+        return NO_WEIGHT;
+    }
+    forward->current = 0;
+    backward->current = 0;
+    pair_relax(pair, forward, source, 0);
+    if (bidirectional) {
+        pair_relax(pair, backward, target, 0);
+        while (pair_lower_bound(forward) + pair_lower_bound(backward) < meeting) {
+            if (pair_lower_bound(forward) <= pair_lower_bound(backward)) {
+                pair_scan_bucket(pair, forward, backward, &meeting);
+            } else {
+                pair_scan_bucket(pair, backward, forward, &meeting);
+            }
+        }
+    } else {
+        while (forward->context.buckets.queued > 0 && forward->context.distances[target] >= forward->current * forward->context.bucket_width) {
+            pair_scan_bucket(pair, forward, NULL, &meeting);
+        }
+        meeting = forward->context.distances[target];
+    }
+    pair_reset(pair);
+    return meeting == WEIGHT_INFINITY ? NO_WEIGHT : meeting;
+}
+
+// This function compares bounded results by distance, then node.
+// Inputs:
+//      const void *a: First result.
+//      const void *b: Second result.
+// Output:
+//      int --> Negative, zero or positive as a is nearer, equal or farther than b.
+static int compare_bounded_results(const void *a, const void *b)
+{
+    const struct dstep_bounded_result *x = (const struct dstep_bounded_result*)a;
+    const struct dstep_bounded_result *y = (const struct dstep_bounded_result*)b;
+    if (x->distance != y->distance) {
+        return x->distance < y->distance ? -1 : 1;
+    }
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+// This function finds the nodes within a radius, or the nearest nodes, of a
+// source node, sorted by distance. Buckets are scanned in order and the search
+// stops once the next bucket starts beyond the radius, or enough nodes are
+// scanned: once a bucket is scanned, the distances of all nodes scanned so far
+// are final, and all other nodes are farther.
+// Inputs:
+//      struct dstep_pair_engine *pair: The point-to-point engine.
+//      index_t source: The source node.
+//      double radius: The radius, negative if unused.
+//      index_t nearest: The nearest nodes count, 0 if unused.
+// Output:
+//      index_t --> Results count, stored in the engine results.
+index_t dstep_bounded_search(struct dstep_pair_engine *pair, index_t source, double radius, index_t nearest)
+{
+    struct dstep_pair_search *forward = &pair->forward;
+    index_t count = 0;
+
+    forward->current = 0;
+    pair_relax(pair, forward, source, 0);
+    while (forward->context.buckets.queued > 0) {
+        if (radius >= 0 && forward->current * forward->context.bucket_width > radius) {
+            break;
+        }
+        if (nearest > 0 && forward->scanned_count > nearest) {
+            break;
+        }
+        pair_scan_bucket(pair, forward, NULL, NULL);
+    }
+
+    for (index_t i = 0; i < pair->touched_count; i++) {
+        index_t node = pair->touched[i];
+        weight_t distance = forward->context.distances[node];
+        if (node == source || (radius >= 0 && distance > radius) || (nearest > 0 && !forward->scanned[node])) {
+            continue;
+        }
+        pair->results[count].node = node;
+        pair->results[count].distance = distance;
+        count ++;
+    }
+    qsort(pair->results, count, sizeof(struct dstep_bounded_result), compare_bounded_results);
+    if (nearest > 0 && count > nearest) {
+        count = nearest;
+    }
+    pair_reset(pair);
+    return count;
+}
+
+// Auxiliary function checking if an edge change decreases or inserts the edge.
+// Inputs:
+//      const struct dstep_edge_change *change: The edge change.
+// Output:
+//      1 --> Edge is decreased or inserted.
+//      0 --> Edge is increased, deleted or unchanged.
+static int is_decrease(const struct dstep_edge_change *change)
+{
+    return change->new_weight != NO_WEIGHT && (change->old_weight == NO_WEIGHT || change->new_weight < change->old_weight);
+}
+
+// This function applies the edge changes of a kind to a Graph.
+// Inputs:
+//      struct dstep_graph *graph: The Graph.
+//      const struct dstep_edge_change *changes: The edge changes.
+//      index_t count: Edge changes count.
+//      int decreases: 1 to apply decreased and inserted edges, 0 for the rest.
+// Output:
+//      1 --> Edge changes applied successfully.
+//      0 --> Memory allocation failed.
+static int apply_changes(struct dstep_graph *graph, const struct dstep_edge_change *changes, index_t count, int decreases)
+{
+    size_t size = count > 0 ? count : 1, applied = 0;
+    index_t *us = (index_t*)malloc(size * sizeof(index_t));
+    index_t *vs = (index_t*)malloc(size * sizeof(index_t));
+    weight_t *weights = (weight_t*)malloc(size * sizeof(weight_t));
+    int done = us != NULL && vs != NULL && weights != NULL;
+
+    for (index_t k = 0; done && k < count; k++) {
+        if (is_decrease(&changes[k]) == decreases) {
+            us[applied] = changes[k].u;
+            vs[applied] = changes[k].v;
+            weights[applied] = changes[k].new_weight;
+            applied ++;
+        }
+    }
+    done = done && dstep_graph_update(graph, applied, us, vs, weights);
+    free(us);
+    free(vs);
+    free(weights);
+    return done;
+}
+
+// Auxiliary function returning a known distance as a double,
+// zero from a node to itself and infinity if unreachable.
+// Inputs:
+//      weight_t **rows: Distances rows.
+//      index_t i: First node.
+//      index_t j: Second node.
+// Output:
+//      double --> The distance.
+static double known_distance(weight_t **rows, index_t i, index_t j)
+{
+    if (i == j) {
+        return 0.0;
+    }
+    return rows[i][j] == NO_WEIGHT ? INFINITY : (double)rows[i][j];
+}
+
+// This function updates the distances through a decreased (or inserted)
+// edge u-v of weight w. A pair s-t improves only if s reaches v faster
+// through the edge and t is reached faster from u through it, so only
+// those sources and targets are visited.
+// Inputs:
+//      weight_t **rows: Distances rows.
+//      index_t nodes_count: Nodes count.
+//      index_t u: Edge first node.
+//      index_t v: Edge second node.
+//      double w: Edge new weight.
+//      index_t *sources: Scratch array of nodes count entries.
+//      index_t *targets: Scratch array of nodes count entries.
+static void decrease_edge(weight_t **rows, index_t nodes_count, index_t u, index_t v, double w, index_t *sources, index_t *targets)
+{
+    index_t i, j, sources_count = 0, targets_count = 0;
+
+    for (i = 0; i < nodes_count; i++) {
+        if (known_distance(rows, i, u) + w < known_distance(rows, i, v)) {
+            sources[sources_count++] = i;
+        }
+        if (w + known_distance(rows, v, i) < known_distance(rows, u, i)) {
+            targets[targets_count++] = i;
+        }
+    }
+    for (i = 0; i < sources_count; i++) {
+        index_t source = sources[i];
+        double to_edge = known_distance(rows, source, u) + w;
+        for (j = 0; j < targets_count; j++) {
+            index_t target = targets[j];
+            double found = to_edge + known_distance(rows, v, target);
+            if (source != target && found < known_distance(rows, source, target)) {
+                rows[source][target] = WEIGHT_FROM_DOUBLE(found);
+            }
+        }
+    }
+}
+
+// Auxiliary function checking if an edge change increases or deletes the edge.
+// Inputs:
+//      const struct dstep_edge_change *change: The edge change.
+// Output:
+//      1 --> Edge is increased or deleted.
+//      0 --> Edge is decreased, inserted or unchanged.
+static int is_increase(const struct dstep_edge_change *change)
+{
+    return !is_decrease(change) && change->old_weight != NO_WEIGHT && change->new_weight != change->old_weight;
+}
+
+// Auxiliary function checking if an edge u-v of weight w is on a shortest
+// path to v, within DSTEP_TIGHT_EPSILON plus DSTEP_TIGHT_RELATIVE times the
+// distance, so large or float distances aren't missed. Extra tight edges only
+// repair more nodes. Unreachable nodes are never tight.
+// Inputs:
+//      double to_u: Distance to u.
+//      double w: Edge weight.
+//      double to_v: Distance to v.
+// Output:
+//      1 --> Edge is tight.
+//      0 --> Edge is not on a shortest path.
+static int is_tight(double to_u, double w, double to_v)
+{
+    if (isinf(to_u) || isinf(to_v)) {
+        return 0;
+    }
+    return fabs(to_u + w - to_v) <= DSTEP_TIGHT_EPSILON + DSTEP_TIGHT_RELATIVE * fmax(fabs(to_u + w), fabs(to_v));
+}
+
+// This function repairs a source distances row after increased or deleted
+// edges, on the Graph they are applied to. Only nodes below a changed edge
+// in the source shortest paths subtree may get longer distances: the heads
+// of tight changed edges, and nodes reached from them through tight edges.
+// They are reset, start from their neighbours outside of the subtree, which
+// keep their distances, and are scanned again from the lowest seeded bucket,
+// so far seeds aren't clamped by the cyclic buckets. The rest of the row is kept.
+// Inputs:
+//      struct dstep_context *context: The solver context, on the changed Graph.
+//      weight_t **rows: Distances rows before the changes.
+//      index_t source: The source node.
+//      const struct dstep_edge_change *changes: The edge changes.
+//      index_t count: Edge changes count.
+//      char *kept: Kept nodes marks, all set, and set again on return.
+//      index_t *subtree: Scratch array of nodes count entries.
+// Output:
+//      index_t --> Repaired nodes count.
+static index_t repair_row(struct dstep_context *context, weight_t **rows, index_t source, const struct dstep_edge_change *changes, index_t count, char *kept, index_t *subtree)
+{
+    const struct dstep_graph *graph = context->graph;
+    weight_t *distances = context->distances;
+    weight_t *row = rows[source];
+    weight_t lowest = WEIGHT_INFINITY;
+    index_t i, k, node, subtree_count = 0;
+
+    for (k = 0; k < count; k++) {
+        const struct dstep_edge_change *change = &changes[k];
+        if (!is_increase(change)) {
+            continue;
+        }
+        double to_u = known_distance(rows, source, change->u);
+        double to_v = known_distance(rows, source, change->v);
+        if (change->v != source && kept[change->v] && is_tight(to_u, (double)change->old_weight, to_v)) {
+            kept[change->v] = 0;
+            subtree[subtree_count++] = change->v;
+        }
+        if (change->u != source && kept[change->u] && is_tight(to_v, (double)change->old_weight, to_u)) {
+            kept[change->u] = 0;
+            subtree[subtree_count++] = change->u;
+        }
+    }
+    for (i = 0; i < subtree_count; i++) {
+        node = subtree[i];
+        double to_node = known_distance(rows, source, node);
+        for (k = graph->offsets[node]; k < graph->offsets[node + 1]; k++) {
+            index_t target = graph->targets[k];
+            if (target != source && kept[target] && is_tight(to_node, (double)graph->weights[k], known_distance(rows, source, target))) {
+                kept[target] = 0;
+                subtree[subtree_count++] = target;
+            }
+        }
+    }
+    // Edges are undirected, so a node edges also lead to it.
+    for (i = 0; i < subtree_count; i++) {
+        node = subtree[i];
+        for (k = graph->offsets[node]; k < graph->offsets[node + 1]; k++) {
+            index_t neighbour = graph->targets[k];
+            if (!kept[neighbour] || (neighbour != source && row[neighbour] == NO_WEIGHT)) {
+                continue;
+            }
+            weight_t seed = (neighbour == source ? 0 : row[neighbour]) + graph->weights[k];
+            distances[node] = seed < distances[node] ? seed : distances[node];
+        }
+        lowest = distances[node] < lowest ? distances[node] : lowest;
+    }
+    index_t current = lowest == WEIGHT_INFINITY ? 0 : (index_t)floor(lowest / context->bucket_width);
+    for (i = 0; i < subtree_count; i++) {
+        node = subtree[i];
+        if (distances[node] != WEIGHT_INFINITY) {
+            enqueue(context, node, distances[node], current);
+        }
+    }
+    scan_phases(context, kept, current);
+    for (i = 0; i < subtree_count; i++) {
+        node = subtree[i];
+        row[node] = distances[node] == WEIGHT_INFINITY ? NO_WEIGHT : distances[node];
+        distances[node] = WEIGHT_INFINITY;
+        kept[node] = 1;
+    }
+    return subtree_count;
+}
+
+// This function updates a Graph distances rows after undirected edge changes,
+// and applies the changes to the Graph. Removed or increased edges may break
+// shortest paths of sources where they were tight (dist(s,u) + w == dist(s,v)),
+// only checked for sources of the edge component. Those sources rows are
+// repaired below the changed edges only, on the Graph without decreased edges,
+// so all rows agree. Then decreased or inserted edges are applied one by one,
+// visiting only improved pairs.
+// Inputs:
+//      struct dstep_graph *graph: The Graph the rows were found on.
+//      double d_step: The D value, positive.
+//      weight_t **rows: Distances rows of all source nodes.
+//      const struct dstep_edge_change *changes: The edge changes, one per edge.
+//      index_t count: Edge changes count.
+//      struct dstep_update_stats *stats: Stores the update statistics.
+// Output:
+//      1 --> Distances updated successfully.
+//      0 --> Memory allocation failed.
+int dstep_update(struct dstep_graph *graph, double d_step, weight_t **rows, const struct dstep_edge_change *changes, index_t count, struct dstep_update_stats *stats)
+{
+    index_t i, k, nodes_count = graph->nodes_count;
+    size_t size = nodes_count > 0 ? nodes_count : 1;
+    struct dstep_context context;
+
+    stats->repaired = 0;
+    stats->reset = 0;
+    stats->decreased = 0;
+    if (!dstep_graph_components(graph)) {
+        return 0;
+    }
+    char *affected = (char*)calloc(size, sizeof(char));
+    char *kept = (char*)malloc(size);
+    index_t *sources = (index_t*)malloc(size * sizeof(index_t));
+    index_t *targets = (index_t*)malloc(size * sizeof(index_t));
+    if (affected == NULL || kept == NULL || sources == NULL || targets == NULL) {
+        free(affected);
+        free(kept);
+        free(sources);
+        free(targets);
+        return 0;
+    }
+    for (k = 0; k < count; k++) {
+        const struct dstep_edge_change *change = &changes[k];
+        if (!is_increase(change)) {
+            continue;
+        }
+        index_t component_count;
+        const index_t *nodes = reachable_nodes(graph, change->u, &component_count);
+        for (index_t j = 0; j < component_count; j++) {
+            i = nodes != NULL ? nodes[j] : j;
+            double to_u = known_distance(rows, i, change->u);
+            double to_v = known_distance(rows, i, change->v);
+            if (is_tight(to_u, (double)change->old_weight, to_v) || is_tight(to_v, (double)change->old_weight, to_u)) {
+                affected[i] = 1;
+            }
+        }
+    }
+    int done = apply_changes(graph, changes, count, 0) && dstep_context_initialize(&context, graph, d_step);
+    if (done) {
+        memset(kept, 1, size);
+        for (i = 0; i < nodes_count; i++) {
+            if (affected[i]) {
+                stats->reset += repair_row(&context, rows, i, changes, count, kept, sources);
+                stats->repaired ++;
+            }
+        }
+        dstep_context_free(&context);
+        for (k = 0; k < count; k++) {
+            if (is_decrease(&changes[k])) {
+                decrease_edge(rows, nodes_count, changes[k].u, changes[k].v, (double)changes[k].new_weight, sources, targets);
+                decrease_edge(rows, nodes_count, changes[k].v, changes[k].u, (double)changes[k].new_weight, sources, targets);
+                stats->decreased ++;
+            }
+        }
+    }
+    free(affected);
+    free(kept);
+    free(sources);
+    free(targets);
+    return done && apply_changes(graph, changes, count, 1);
+}
+
+// This function initializes a row cache, all slots empty.
+// Inputs:
+//      struct dstep_row_cache *cache: The row cache.
+//      index_t nodes_count: Distances per row.
+//      index_t capacity: Slots count, kept between 1 and nodes count.
+// Output:
+//      1 --> Row cache initialized successfully.
+//      0 --> Memory allocation failed.
+int dstep_row_cache_initialize(struct dstep_row_cache *cache, index_t nodes_count, index_t capacity)
+{
+    memset(cache, 0, sizeof(struct dstep_row_cache));
+    capacity = capacity < nodes_count ? capacity : nodes_count;
+    capacity = capacity > 1 ? capacity : 1;
+    cache->nodes_count = nodes_count;
+    cache->capacity = capacity;
+    cache->rows = (weight_t*)malloc(sizeof(weight_t) * (nodes_count > 0 ? nodes_count : 1) * capacity);
+    cache->sources = (index_t*)malloc(capacity * sizeof(index_t));
+    cache->newer = (index_t*)malloc(capacity * sizeof(index_t));
+    cache->older = (index_t*)malloc(capacity * sizeof(index_t));
+    cache->slots = (index_t*)malloc((nodes_count > 0 ? nodes_count : 1) * sizeof(index_t));
+    if (cache->rows == NULL || cache->sources == NULL || cache->newer == NULL || cache->older == NULL || cache->slots == NULL) {
+        dstep_row_cache_free(cache);
+        return 0;
+    }
+    for (index_t i = 0; i < nodes_count; i++) {
+        cache->slots[i] = -1;
+    }
+    cache->newest = -1;
+    cache->oldest = -1;
+    return 1;
+}
+
+// This function frees allocated memory of a row cache.
+// Inputs:
+//      struct dstep_row_cache *cache: The row cache.
+void dstep_row_cache_free(struct dstep_row_cache *cache)
+{
+    free(cache->rows);
+    free(cache->sources);
+    free(cache->newer);
+    free(cache->older);
+    free(cache->slots);
+    cache->rows = NULL;
+    cache->sources = NULL;
+    cache->newer = NULL;
+    cache->older = NULL;
+    cache->slots = NULL;
+}
+
+// This function unlinks a slot from the row cache recency list.
+// Inputs:
+//      struct dstep_row_cache *cache: The row cache.
+//      index_t slot: The slot.
+static void row_cache_unlink(struct dstep_row_cache *cache, index_t slot)
+{
+    if (cache->newer[slot] != -1) {
+        cache->older[cache->newer[slot]] = cache->older[slot];
+    } else {
+        cache->newest = cache->older[slot];
+    }
+    if (cache->older[slot] != -1) {
+        cache->newer[cache->older[slot]] = cache->newer[slot];
+    } else {
+        cache->oldest = cache->newer[slot];
+    }
+}
+
+// This function links a slot as the newest of the row cache recency list.
+// Inputs:
+//      struct dstep_row_cache *cache: The row cache.
+//      index_t slot: The slot.
+static void row_cache_link_newest(struct dstep_row_cache *cache, index_t slot)
+{
+    cache->newer[slot] = -1;
+    cache->older[slot] = cache->newest;
+    if (cache->newest != -1) {
+        cache->newer[cache->newest] = slot;
+    } else {
+        cache->oldest = slot;
+    }
+    cache->newest = slot;
+}
+
+// This function finds the cached distances row of a source node, making
+// it the most recently used one.
+// Inputs:
+//      struct dstep_row_cache *cache: The row cache.
+//      index_t source: The source node.
+// Output:
+//      weight_t * --> The distances row, NULL if not cached.
+weight_t *dstep_row_cache_find(struct dstep_row_cache *cache, index_t source)
+{
+    index_t slot = cache->slots[source];
+    if (slot == -1) {
+        return NULL;
+    }
+    cache->hits ++;
+    row_cache_unlink(cache, slot);
+    row_cache_link_newest(cache, slot);
+    return cache->rows + (size_t)cache->nodes_count * slot;
+}
+
+// This function inserts the distances row of a source node, not cached,
+// evicting the least recently used row when the cache is full.
+// Inputs:
+//      struct dstep_row_cache *cache: The row cache.
+//      index_t source: The source node.
+// Output:
+//      weight_t * --> The distances row to fill.
+weight_t *dstep_row_cache_insert(struct dstep_row_cache *cache, index_t source)
+{
+    index_t slot;
+
+    cache->misses ++;
+    if (cache->used < cache->capacity) {
+        slot = cache->used++;
+    } else {
+        slot = cache->oldest;
+        row_cache_unlink(cache, slot);
+        cache->slots[cache->sources[slot]] = -1;
+    }
+    cache->sources[slot] = source;
+    cache->slots[source] = slot;
+    row_cache_link_newest(cache, slot);
+    return cache->rows + (size_t)cache->nodes_count * slot;
+}
+
+// This function formats a distance as printf "%lf" does, -1.000000 for
+// NO_WEIGHT, without the locale and varargs overhead of printf. The double
+// is decomposed as m * 2^e and m * 10^6 is rounded exactly, ties to even,
+// so the result matches printf byte for byte. Huge, infinite or NaN
+// distances fall back to snprintf.
+// Inputs:
+//      char *buffer: The buffer, holding at least DSTEP_DISTANCE_WIDTH characters.
+//      weight_t distance: The distance.
+// Output:
+//      int --> Characters written, not NUL terminated.
+int dstep_format_distance(char *buffer, weight_t distance)
+{
+    double value = distance == NO_WEIGHT ? -1.0 : (double)distance;
+    char digits[24];
+    int length = 0, count = 0, exponent;
+    uint64_t micros;
+
+    if (!(fabs(value) < FORMAT_FAST_BOUND)) {
+        return snprintf(buffer, DSTEP_DISTANCE_WIDTH, "%lf", value);
+    }
+    if (signbit(value)) {
+        buffer[length++] = '-';
+        value = -value;
+    }
+    uint64_t mantissa = (uint64_t)ldexp(frexp(value, &exponent), 53);
+    exponent -= 53;
+    if (exponent >= 0) {
+        micros = (mantissa << exponent) * 1000000;
+    } else if (exponent < -73) {
+        // mantissa * 10^6 < 2^73, so the value rounds to 0.
+        micros = 0;
+    } else {
+        unsigned __int128 scaled = (unsigned __int128)mantissa * 1000000;
+        unsigned __int128 half = (unsigned __int128)1 << (-exponent - 1);
+        micros = (uint64_t)(scaled >> -exponent);
+        unsigned __int128 rest = scaled - ((unsigned __int128)micros << -exponent);
+        if (rest > half || (rest == half && (micros & 1))) {
+            micros ++;
+        }
+    }
+    uint64_t integer = micros / 1000000;
+    uint32_t fraction = (uint32_t)(micros % 1000000);
+    do {
+        digits[count++] = '0' + integer % 10;
+        integer /= 10;
+    } while (integer > 0);
+    while (count > 0) {
+        buffer[length++] = digits[--count];
+    }
+    buffer[length++] = '.';
+    for (int k = 5; k >= 0; k--) {
+        buffer[length + k] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    return length + 6;
+}
+
+// This function ensures a text buffer can hold more characters, growing
+// it as needed, and marks it failed when memory allocation fails.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      size_t size: Characters count to hold after the current ones.
+// Output:
+//      1 --> Characters can be appended.
+//      0 --> Memory allocation failed.
+static int text_reserve(struct dstep_text *text, size_t size)
+{
+    if (text->failed) {
+        return 0;
+    }
+    if (text->size + size <= text->capacity) {
+        return 1;
+    }
+    size_t capacity = text->capacity > 0 ? text->capacity : 4096;
+    while (text->size + size > capacity) {
+        capacity *= 2;
+    }
+    char *data = (char*)realloc(text->data, capacity);
+    if (data == NULL) {
+        text->failed = 1;
+        return 0;
+    }
+    text->data = data;
+    text->capacity = capacity;
+    return 1;
+}
+
+// This function appends a distance followed by a space to a text buffer,
+// formatted as "%lf " does.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      weight_t distance: The distance, NO_WEIGHT written as -1.
+void dstep_text_append_distance(struct dstep_text *text, weight_t distance)
+{
+    if (text_reserve(text, DSTEP_DISTANCE_WIDTH + 1)) {
+        text->size += dstep_format_distance(text->data + text->size, distance);
+        text->data[text->size++] = ' ';
+    }
+}
+
+// This function appends a node id to a text buffer.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      index_t node: The node.
+void dstep_text_append_node(struct dstep_text *text, index_t node)
+{
+    if (text_reserve(text, 32)) {
+        text->size += snprintf(text->data + text->size, 32, INDEX_FORMAT, node);
+    }
+}
+
+// This function appends a character to a text buffer.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      char c: The character.
+void dstep_text_append_char(struct dstep_text *text, char c)
+{
+    if (text_reserve(text, 1)) {
+        text->data[text->size++] = c;
+    }
+}
+
+// This function writes a text buffer to a file descriptor and empties it.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      int fd: The file descriptor.
+// Output:
+//      1 --> Text written successfully.
+//      0 --> Memory allocation or writing failed.
+int dstep_text_write(struct dstep_text *text, int fd)
+{
+    size_t written = 0;
+
+    if (text->failed) {
+        return 0;
+    }
+    while (written < text->size) {
+        ssize_t count = write(fd, text->data + written, text->size - written);
+        if (count < 0) {
+            return 0;
+        }
+        written += count;
+    }
+    text->size = 0;
+    return 1;
+}
+
+// This function frees allocated memory of a text buffer.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+void dstep_text_free(struct dstep_text *text)
+{
+    free(text->data);
+    text->data = NULL;
+    text->size = 0;
+    text->capacity = 0;
+    text->failed = 0;
+}
+
+// This function formats a text writer block of lines, run by its thread.
+// Inputs:
+//      void *arg: The text writer.
+// Output:
+//      void * --> NULL.
+static void *text_writer_run(void *arg)
+{
+    struct dstep_text_writer *writer = (struct dstep_text_writer*)arg;
+    for (index_t line = writer->first; line < writer->last; line++) {
+        writer->format_line(&writer->text, line, writer->data);
+    }
+    return NULL;
+}
+
+// This function formats lines in parallel and writes them in order. Each
+// text writer thread formats a block of consecutive lines into its own
+// buffer, then buffers are written in order with few large write calls.
+// Inputs:
+//      int fd: The file descriptor.
+//      index_t count: Lines count, formatted as lines 0 to count - 1.
+//      index_t writers_count: Text writer threads, 0 for one per online processor.
+//      size_t line_size: Estimated characters per line, sizing the blocks.
+//      dstep_format_line format_line: Line formatter.
+//      void *data: Line formatter data.
+// Output:
+//      1 --> Lines written successfully.
+//      0 --> Memory allocation, thread creation or writing failed.
+int dstep_write_lines(int fd, index_t count, index_t writers_count, size_t line_size, dstep_format_line format_line, void *data)
+{
+    index_t w, block = DSTEP_TEXT_BLOCK_SIZE / (line_size > 0 ? line_size : 1);
+    int done = 1;
+
+    if (writers_count <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        writers_count = online > 0 ? (index_t)online : 1;
+    }
+    if (block < 1) {
+        block = 1;
+    }
+    // No more writers than blocks.
+    if (writers_count > (count + block - 1) / block) {
+        writers_count = count > 0 ? (count + block - 1) / block : 1;
+    }
+    struct dstep_text_writer *writers = (struct dstep_text_writer*)calloc(writers_count, sizeof(struct dstep_text_writer));
+    if (writers == NULL) {
+        return 0;
+    }
+    for (w = 0; w < writers_count; w++) {
+        writers[w].format_line = format_line;
+        writers[w].data = data;
+    }
+    for (index_t first = 0; done && first < count; first += block * writers_count) {
+        index_t started = 1;
+        for (w = 0; w < writers_count; w++) {
+            writers[w].first = first + w * block < count ? first + w * block : count;
+            writers[w].last = writers[w].first + block < count ? writers[w].first + block : count;
+        }
+        for (; started < writers_count; started++) {
+            if (pthread_create(&writers[started].thread, NULL, text_writer_run, &writers[started]) != 0) {
+                break;
+            }
+        }
+        // Blocks of writers that failed to start are formatted here.
+        for (w = started; w < writers_count; w++) {
+            text_writer_run(&writers[w]);
+        }
+        text_writer_run(&writers[0]);
+        for (w = 0; w < writers_count; w++) {
+            if (w > 0 && w < started) {
+                pthread_join(writers[w].thread, NULL);
+            }
+            done = done && dstep_text_write(&writers[w].text, fd);
+        }
+    }
+    for (w = 0; w < writers_count; w++) {
+        dstep_text_free(&writers[w].text);
+    }
+    free(writers);
+    return done;
+}
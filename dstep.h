@@ -0,0 +1,370 @@
+// -------------------------------------------------------
+//
+// D-Stepping library, implementing the D-Stepping algorithm
+// introduced by U.Mayers and P.Sanders as reentrant calls.
+// A Graph is built once and shared read-only by solver
+// contexts, each holding its own state, so contexts can
+// find distances concurrently in different threads.
+//
+// -------------------------------------------------------
+
+#ifndef DSTEP_H
+#define DSTEP_H
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+
+// Index type used for nodes and sizes. Defining INDEX64 at compile time
+// selects 64-bit indexing, required for Graphs beyond ~46k nodes where
+// nodes count squared no longer fits an int.
+#ifdef INDEX64
+typedef int64_t index_t;
+#define INDEX_FORMAT "%" PRId64
+#define INDEX_SCAN "%" SCNd64
+#else
+typedef int index_t;
+#define INDEX_FORMAT "%d"
+#define INDEX_SCAN "%d"
+#endif
+
+// Weight type used for edges and distances. Defining WEIGHT_FLOAT or
+// WEIGHT_UINT32 at compile time selects a compact type, halving memory
+// traffic. NO_WEIGHT marks missing edges and unreached nodes, while
+// WEIGHT_FROM_DOUBLE converts weights read from the input file.
+// Note: uint32 distances are sums of weights, so they must fit 32 bits.
+// WEIGHT_INFINITY marks unreached nodes while searching, so sums
+// with it never win a min(); for uint32 it is half the range to avoid
+// overflowing.
+#if defined(WEIGHT_FLOAT)
+typedef float weight_t;
+#define NO_WEIGHT -1
+#define WEIGHT_FROM_DOUBLE(w) ((float)(w))
+#define WEIGHT_INFINITY INFINITY
+#elif defined(WEIGHT_UINT32)
+typedef uint32_t weight_t;
+#define NO_WEIGHT UINT32_MAX
+#define WEIGHT_FROM_DOUBLE(w) ((uint32_t)llround(w))
+#define WEIGHT_INFINITY (UINT32_MAX / 2)
+#else
+typedef double weight_t;
+#define NO_WEIGHT -1
+#define WEIGHT_FROM_DOUBLE(w) (w)
+#define WEIGHT_INFINITY INFINITY
+#endif
+
+// Sources count processed together by batched calls.
+#ifndef BATCH_SIZE
+#define BATCH_SIZE 8
+#endif
+
+// Buckets a phase may span beyond those covering the heaviest edge,
+// bounding the phase width of the adaptive and radius strategies.
+#ifndef DSTEP_PHASE_BUCKETS
+#define DSTEP_PHASE_BUCKETS 64
+#endif
+
+// Buckets per D of the adaptive and radius strategies, so their phases
+// may also be narrower than D.
+#ifndef DSTEP_PHASE_SPLIT
+#define DSTEP_PHASE_SPLIT 8
+#endif
+
+// Nodes scanned per phase the adaptive strategy aims for: phases scanning
+// fewer nodes widen, unless re-insertions show the phase is already too wide.
+#ifndef DSTEP_FRONTIER_TARGET
+#define DSTEP_FRONTIER_TARGET 64
+#endif
+
+// Maximum characters written by dstep_format_distance, the "%lf" format
+// of the largest double with its sign.
+#define DSTEP_DISTANCE_WIDTH 320
+
+// Output characters formatted by each text writer thread before they are
+// written. Can be overridden at compile time.
+#ifndef DSTEP_TEXT_BLOCK_SIZE
+#define DSTEP_TEXT_BLOCK_SIZE ((size_t)1 << 22)
+#endif
+
+// Integer distance type used by the radix engine.
+typedef uint64_t dstep_radix_t;
+#define DSTEP_RADIX_INFINITY UINT64_MAX
+
+// Largest power of ten tried when finding the radix engine scale.
+#ifndef DSTEP_RADIX_DIGITS
+#define DSTEP_RADIX_DIGITS 9
+#endif
+
+// Distances of previous and changed Graph within DSTEP_TIGHT_EPSILON, plus
+// DSTEP_TIGHT_RELATIVE times the distance, are considered equal by updates:
+// previous distances are read as text with 6 decimals, and sums of weights
+// carry rounding errors relative to their size, larger for float weights.
+#ifndef DSTEP_TIGHT_EPSILON
+#define DSTEP_TIGHT_EPSILON 1e-5
+#endif
+#ifndef DSTEP_TIGHT_RELATIVE
+#if defined(WEIGHT_FLOAT)
+#define DSTEP_TIGHT_RELATIVE 1e-4
+#elif defined(WEIGHT_UINT32)
+#define DSTEP_TIGHT_RELATIVE 0
+#else
+#define DSTEP_TIGHT_RELATIVE 1e-12
+#endif
+#endif
+
+// Bucket strategies, choosing the buckets scanned by each phase. A phase
+// scans its buckets until they are all empty, so any strategy finds the
+// same distances, only the work differs.
+enum dstep_strategy {
+    DSTEP_STRATEGY_FIXED,    // Each phase scans a single D wide bucket, the D-Stepping default.
+    DSTEP_STRATEGY_ADAPTIVE, // Phases start D wide, doubling while they scan few nodes, halving when nodes are re-inserted.
+    DSTEP_STRATEGY_RADIUS    // Radius-stepping: a phase ends at the lowest distance plus radius of its first bucket nodes.
+};
+
+// Linked buckets structure: buckets are doubly linked lists threaded
+// through the nodes, so inserting, moving and removing nodes is O(1).
+struct dstep_buckets {
+    index_t *heads;         // First node of each bucket.
+    index_t *next;          // Next node in the same bucket.
+    index_t *prev;          // Previous node in the same bucket.
+    index_t *node_buckets;  // Bucket containing each node, -1 if none.
+    index_t count;          // Buckets count.
+    index_t queued;         // Nodes count in all buckets.
+};
+
+// Nodes orderings, relabelling Graph nodes for locality.
+enum dstep_ordering {
+    DSTEP_ORDERING_RCM,    // Reverse Cuthill-McKee ordering.
+    DSTEP_ORDERING_DEGREE  // Descending degree ordering.
+};
+
+// Graph structure, holding each node edges contiguously in compressed rows.
+// Built once, it is only read while finding distances. Once its connected
+// components are labelled, searches only visit the source node component.
+struct dstep_graph {
+    index_t nodes_count;        // Nodes count.
+    index_t *offsets;           // First edge of each node, nodes count + 1 entries.
+    index_t *targets;           // Edges target node.
+    weight_t *weights;          // Edges weight.
+    weight_t max_weight;        // Heaviest edge weight.
+    index_t components_count;   // Connected components count, 0 if not labelled.
+    index_t *components;        // Connected component of each node, NULL if not labelled.
+    index_t *component_offsets; // First node of each component, components count + 1 entries.
+    index_t *component_nodes;   // Nodes grouped by component, ascending ids within each.
+    index_t *component_edges;   // Edges count of each component.
+};
+
+// Solver context structure, holding the state of the calls finding
+// distances on a Graph. Each thread needs its own context.
+struct dstep_context {
+    const struct dstep_graph *graph; // Graph used.
+    double d_step;                   // D value used.
+    double bucket_width;             // Buckets width, D or D / DSTEP_PHASE_SPLIT.
+    weight_t *distances;             // Tentative distances of single source calls.
+    weight_t *batch_distances;       // BATCH_SIZE distances per node, of batched calls.
+    weight_t *pending;               // Lowest improved distance of each node since its last scan, of batched calls.
+    struct dstep_buckets buckets;    // Cyclic buckets.
+    enum dstep_strategy strategy;    // Bucket strategy.
+    index_t width;                   // Phase width in buckets, of the adaptive strategy.
+    weight_t *radii;                 // Radius of each node, of the radius strategy.
+    size_t *scanned;                 // Phase each node was last scanned in, marking re-insertions.
+    size_t phase_scans;              // Node scans of the running phase.
+    size_t phase_reinsertions;       // Re-inserted nodes of the running phase.
+    size_t phases;                   // Phases count of all calls.
+    size_t scans;                    // Node scans count of all calls.
+};
+
+// Radix engine Graph structure. Weights are quantized to integers
+// and edges are stored per node in compressed rows, light edges first.
+struct dstep_radix_graph {
+    const struct dstep_graph *graph; // Graph quantized, its components restrict searches.
+    index_t *offsets;                // First edge of each node, nodes count + 1 entries.
+    index_t *light_ends;             // End of each node light edges.
+    index_t *targets;                // Edges target node.
+    dstep_radix_t *weights;          // Edges quantized weight.
+    double scale;                    // Weights quantization scale.
+    int shift;                       // D value as a power of two exponent.
+    index_t buckets_count;           // Cyclic buckets count, covering the heaviest edge.
+};
+
+// Radix engine structure, holding per source node state.
+struct dstep_radix_engine {
+    const struct dstep_radix_graph *radix; // Radix engine Graph used.
+    dstep_radix_t *distances;              // Tentative distances.
+    struct dstep_buckets buckets;          // Cyclic buckets.
+    index_t *frontier;                     // Nodes removed from the current bucket.
+    index_t *settled;                      // Nodes settled in the current bucket.
+    char *is_settled;                      // Settled nodes marks.
+};
+
+// Dense engine Graph structure, a padded matrix where missing edges are
+// WEIGHT_INFINITY, so rows are relaxed branch-free by min-plus updates.
+struct dstep_dense_graph {
+    const struct dstep_graph *graph; // Graph copied, its components restrict searches.
+    weight_t *weights;               // Graph matrix, stride weights per row, 32 bytes aligned.
+    index_t stride;                  // Padded row length.
+};
+
+// Dense engine structure, holding per source node state.
+struct dstep_dense_engine {
+    const struct dstep_dense_graph *dense; // Dense engine Graph used.
+    double d_step;                         // D value used.
+    weight_t *distances;                   // Tentative distances.
+    unsigned char *state;                  // Node states, clean, pending or settled.
+};
+
+// Symmetric engine structure, used for undirected APSP. Distances are
+// stored as the upper triangle only, and rows of previous sources seed
+// tentative distances of later ones.
+struct dstep_symmetric_engine {
+    struct dstep_context context; // Solver context, holding distances and buckets.
+    weight_t *triangle;           // Upper triangle distances, row by row.
+    char *exact;                  // Nodes whose distance is already known.
+};
+
+// Point-to-point search structure, holding one direction state.
+struct dstep_pair_search {
+    struct dstep_context context; // Solver context, holding distances and buckets.
+    index_t current;              // Next bucket to scan.
+    char *scanned;                // Scanned nodes marks, their distances are final once their bucket is.
+    index_t scanned_count;        // Scanned nodes count.
+};
+
+// Bounded result structure, a node and its distance from the source node.
+struct dstep_bounded_result {
+    index_t node;      // Node.
+    weight_t distance; // Distance from the source node.
+};
+
+// Point-to-point engine structure, used for source-target queries
+// and bounded searches.
+// The forward search starts from the source node and the backward one,
+// used by the bidirectional variant, from the target node. Only touched
+// nodes are reset between queries, so a query costs the explored region.
+struct dstep_pair_engine {
+    const struct dstep_graph *graph;      // Graph used.
+    struct dstep_pair_search forward;     // Search from the source node.
+    struct dstep_pair_search backward;    // Search from the target node.
+    index_t *touched;                     // Nodes reached by any search.
+    index_t touched_count;                // Touched nodes count.
+    struct dstep_bounded_result *results; // Results of the last bounded search, sorted by distance.
+};
+
+// Edge change structure, used by updates.
+struct dstep_edge_change {
+    index_t u;           // First node.
+    index_t v;           // Second node.
+    weight_t old_weight; // Weight before the changes, NO_WEIGHT if missing.
+    weight_t new_weight; // Weight after the changes, NO_WEIGHT if deleted.
+};
+
+// Update statistics structure.
+struct dstep_update_stats {
+    index_t repaired;         // Sources whose rows were repaired after increased or deleted edges.
+    unsigned long long reset; // Distances reset and found again by the repairs.
+    index_t decreased;        // Decreased or inserted edges applied.
+};
+
+// Text buffer structure, holding formatted output lines until they are
+// written with a single write call. Appends after a failed allocation
+// are dropped, and writing the buffer fails.
+struct dstep_text {
+    char *data;      // Formatted characters.
+    size_t size;     // Characters count.
+    size_t capacity; // Allocated characters count.
+    int failed;      // Memory allocation failed.
+};
+
+// Line formatter, appending a line to a text buffer. Called concurrently by
+// the text writer threads, each with its own buffer.
+typedef void (*dstep_format_line)(struct dstep_text *text, index_t line, void *data);
+
+// Row cache structure. Keeps recently found distances rows, evicting the
+// least recently used row when full. Slots are linked from the newest to
+// the oldest.
+struct dstep_row_cache {
+    index_t nodes_count; // Distances per row.
+    weight_t *rows;      // Cached rows.
+    index_t *sources;    // Source node of each slot.
+    index_t *slots;      // Slot of each source node, -1 if not cached.
+    index_t *newer;      // Next more recently used slot, -1 if newest.
+    index_t *older;      // Next less recently used slot, -1 if oldest.
+    index_t newest;      // Most recently used slot.
+    index_t oldest;      // Least recently used slot.
+    index_t capacity;    // Slots count.
+    index_t used;        // Slots used.
+    size_t hits;         // Rows found in the cache.
+    size_t misses;       // Rows inserted in the cache.
+};
+
+// Linked buckets.
+int dstep_buckets_initialize(struct dstep_buckets *buckets, index_t count, index_t nodes_count);
+void dstep_buckets_free(struct dstep_buckets *buckets);
+void dstep_buckets_insert(struct dstep_buckets *buckets, index_t node, index_t bucket);
+void dstep_buckets_remove(struct dstep_buckets *buckets, index_t node);
+
+// Graph.
+int dstep_graph_initialize(struct dstep_graph *graph, index_t nodes_count, weight_t **matrix);
+int dstep_graph_read(struct dstep_graph *graph, FILE *file);
+int dstep_graph_permute(struct dstep_graph *graph, const index_t *new_ids);
+weight_t dstep_graph_weight(const struct dstep_graph *graph, index_t source, index_t target);
+int dstep_graph_update(struct dstep_graph *graph, size_t count, const index_t *sources, const index_t *targets, const weight_t *weights);
+int dstep_graph_reorder(struct dstep_graph *graph, enum dstep_ordering ordering, index_t *new_ids, index_t *old_ids);
+int dstep_graph_components(struct dstep_graph *graph);
+index_t dstep_component_size(const struct dstep_graph *graph, index_t node);
+double dstep_search_cost(const struct dstep_graph *graph, index_t source);
+void dstep_graph_free(struct dstep_graph *graph);
+
+// Solver context.
+int dstep_context_initialize(struct dstep_context *context, const struct dstep_graph *graph, double d_step);
+void dstep_context_free(struct dstep_context *context);
+int dstep_context_strategy(struct dstep_context *context, enum dstep_strategy strategy, index_t rho);
+void dstep_sssp(struct dstep_context *context, index_t source, weight_t *row);
+void dstep_apsp(struct dstep_context *context, index_t first_source, index_t count, weight_t **rows);
+
+// Radix engine.
+double dstep_radix_scale(const struct dstep_graph *graph, double d_step, double scale);
+int dstep_radix_graph_initialize(struct dstep_radix_graph *radix, const struct dstep_graph *graph, double d_step, double scale);
+void dstep_radix_graph_free(struct dstep_radix_graph *radix);
+int dstep_radix_initialize(struct dstep_radix_engine *engine, const struct dstep_radix_graph *radix);
+void dstep_radix_free(struct dstep_radix_engine *engine);
+void dstep_radix_sssp(struct dstep_radix_engine *engine, index_t source, weight_t *row);
+
+// Dense engine.
+int dstep_dense_graph_initialize(struct dstep_dense_graph *dense, const struct dstep_graph *graph);
+void dstep_dense_graph_free(struct dstep_dense_graph *dense);
+int dstep_dense_initialize(struct dstep_dense_engine *engine, const struct dstep_dense_graph *dense, double d_step);
+void dstep_dense_free(struct dstep_dense_engine *engine);
+void dstep_dense_sssp(struct dstep_dense_engine *engine, index_t source, weight_t *row);
+
+// Symmetric engine.
+int dstep_symmetric_initialize(struct dstep_symmetric_engine *engine, const struct dstep_graph *graph, double d_step);
+void dstep_symmetric_free(struct dstep_symmetric_engine *engine);
+void dstep_symmetric_sssp(struct dstep_symmetric_engine *engine, index_t source);
+weight_t dstep_symmetric_distance(const struct dstep_symmetric_engine *engine, index_t i, index_t j);
+
+// Point-to-point engine.
+int dstep_pair_initialize(struct dstep_pair_engine *pair, const struct dstep_graph *graph, double d_step);
+void dstep_pair_free(struct dstep_pair_engine *pair);
+weight_t dstep_pair_distance(struct dstep_pair_engine *pair, index_t source, index_t target, int bidirectional);
+index_t dstep_bounded_search(struct dstep_pair_engine *pair, index_t source, double radius, index_t nearest);
+
+// Updates.
+int dstep_update(struct dstep_graph *graph, double d_step, weight_t **rows, const struct dstep_edge_change *changes, index_t count, struct dstep_update_stats *stats);
+
+// Row cache.
+int dstep_row_cache_initialize(struct dstep_row_cache *cache, index_t nodes_count, index_t capacity);
+void dstep_row_cache_free(struct dstep_row_cache *cache);
+weight_t *dstep_row_cache_find(struct dstep_row_cache *cache, index_t source);
+weight_t *dstep_row_cache_insert(struct dstep_row_cache *cache, index_t source);
+
+// Text output.
+int dstep_format_distance(char *buffer, weight_t distance);
+void dstep_text_append_distance(struct dstep_text *text, weight_t distance);
+void dstep_text_append_node(struct dstep_text *text, index_t node);
+void dstep_text_append_char(struct dstep_text *text, char c);
+int dstep_text_write(struct dstep_text *text, int fd);
+void dstep_text_free(struct dstep_text *text);
+int dstep_write_lines(int fd, index_t count, index_t writers_count, size_t line_size, dstep_format_line format_line, void *data);
+
+#endif
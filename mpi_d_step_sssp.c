@@ -14,346 +14,145 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
-// Bucket structure
-struct bucket {
-    int *delta;
-    int *nodes;
-};
+#include "dstep.h"
+
+// MPI types of the index and weight types.
+#ifdef INDEX64
+#define MPI_INDEX MPI_INT64_T
+#else
+#define MPI_INDEX MPI_INT
+#endif
+#if defined(WEIGHT_FLOAT)
+#define MPI_WEIGHT MPI_FLOAT
+#elif defined(WEIGHT_UINT32)
+#define MPI_WEIGHT MPI_UINT32_T
+#else
+#define MPI_WEIGHT MPI_DOUBLE
+#endif
 
 double d_step;          // D value used.
 FILE *fin;              // Input file.
 FILE *fout;             // Output file.
-int nodes_count;        // Graph nodes count.
-double **matrix;        // Graph nodes matrix.
-struct bucket *buckets; // Buckets array.
-double **distances;     // Shortest path distance from each node to all other nodes.
-int *light_nodes;       // Light nodes array.
-int *heavy_nodes;       // Heavy nodes array.
-int *visited_nodes;     // Visited nodes array, used to prevent loops.
-int *updated_nodes;     // Updated nodes array, used to also update visited neighbors.
-int source_node;        // Source node to find distances.
+index_t nodes_count;    // Graph nodes count.
+struct dstep_graph graph;       // Graph compressed rows, read by P0 and broadcasted.
+struct dstep_context context;   // Process solver context.
+enum dstep_strategy strategy;   // Bucket strategy.
+index_t rho = 4;                // Lightest edges rank used as node radius by the radius strategy.
+index_t writers_count;          // Output formatting threads of P0, 0 for one per online processor.
+unsigned long long phases[2];   // Phases and node scans counts of all processes, gathered by P0.
+index_t *owners;        // Process finding the distances of each source node.
+index_t *slots;         // Row slot of each source node found by the process, -1 for other processes ones.
+weight_t *rows;         // Distances rows of the process source nodes, nodes count distances each.
+index_t rows_count;     // Process source nodes count.
+index_t source_node;    // Source node to find distances.
 clock_t t1, t2;         // Variables for measuring time spent.
+char *checkpoint_filename;      // Checkpoint files name, suffixed by each process rank, NULL if unused.
+FILE *fcheckpoint;              // Process checkpoint file.
+double checkpoint_interval = 60; // Seconds between checkpoint file syncs.
+int resume;                     // Resume from the checkpoint files completed sources.
+char *completed;                // Completed source nodes marks, used with checkpoints.
+double last_checkpoint;         // Last checkpoint file sync time.
 
-// This function inserts a given value at the end of a given array.
-// Inputs:
-//      int *array: The array.
-//      int node: The value to insert.
-void push_node(int *array, int node)
-{
-    int pos = 0;    
-    int item = array[0];    
-    while (item != node && item != -1) {
-        pos ++;
-        item = array[pos];        
-    }
-    array[pos] = node;
-}
+// Maximum elements transferred by a single MPI call, since MPI counts are int.
+#define MPI_CHUNK ((size_t)1 << 30)
 
-// This function removes all values of a given array.
-// Inputs:
-//      int *array: The array.
-void empty_array(int *array)
-{
-    int pos = 0;    
-    int item = array[pos];    
-    while (item != -1) {
-        array[pos] = -1;
-        pos ++;
-        item = array[pos];        
-    }    
-}
+// Checkpoint file identifier, written first, followed by the index and weight
+// types sizes and the nodes count. Each next record is a completed source node
+// and its distances row.
+#define CHECKPOINT_MAGIC "DSTEPCK1"
 
-// This function checks if a given array contains a given value.
-// Inputs:
-//      int *array: The array.
-//      int node: The value to check.
-// Output:
-//      1 --> The array contains the value.
-//      0 --> The array doesn't contains the value.
-int contains(int *array, int node)
-{
-    int pos = 0;    
-    int item = array[pos];    
-    while (item != node && item != -1) {
-        pos ++;
-        item = array[pos];        
-    }
-    return array[pos] == node;
-}
+// Distances bytes of consecutive rows sent to P0 by a single message.
+#define RUN_SIZE ((size_t)1 << 24)
 
-// This functions cleanses all empty buckets so they can be used again. 
-// Also it will return the first non empty bucket or the last one,
-// in case all are empty.
-// Output:
-//      struct bucket --> Returned bucket.
-struct bucket find_next_bucket()
-{
-    for (int i = 0; i < nodes_count; i++) {
-        if (buckets[i].nodes[0] == -1) {
-            buckets[i].delta[0] = -1;        
-        }    
-    }
-    int pos = 0;
-    struct bucket item = buckets[pos];
-    while (item.delta[0] == -1 && pos + 1 < nodes_count) {
-        pos ++;
-        item = buckets[pos];    
-    }
-    return item;
-}
-
-// This functions retrieves the bucket for a given D value.
-// If the bucket doesn't exists, it assigns it to a cleansed one.
+// This function estimates the cost of a source node, as the search cost
+// of its component plus its row, nodes count distances sent and written.
 // Inputs:
-//      int d: The D value to search.
+//      index_t source: The source node.
 // Output:
-//      struct bucket --> Returned bucket.
-struct bucket retrieve_bucket(int d)
+//      double --> The estimated cost.
+double source_cost(index_t source)
 {
-    struct bucket b;
-    b.delta = (int*)malloc(sizeof(int));
-    if (b.delta == NULL) {
-        printf("Error: b.delta for mult failed.\n");
-        exit(1);
-    }
-    b.delta[0] = -1;
-    for (int i = 0; i < nodes_count; i++) {
-        if (buckets[i].delta[0] == d) {
-            b = buckets[i];    
-            break;    
-        }    
-    }
-    if (b.delta[0] != d) {
-        int pos = 0;
-        b = buckets[0];
-        while (b.delta[0] != -1) {
-            pos ++;
-            b = buckets[pos];    
-        }
-        b.delta[0] = d;        
-    }
-    return b;
+    return dstep_search_cost(&graph, source) + nodes_count;
 }
 
-// This functions add nodes contained in a given bucket to the 
-// Visited nodes array and relaxes(insert to appropriate bucket) nodes 
-// contained in a given array.
+// This function assigns source nodes to processes, each process finding
+// the distances of a consecutive block of source nodes, so rows are still
+// sent to P0 in long runs. Blocks are split by estimated cost, instead of
+// nodes count, so processes given large components get fewer sources.
 // Inputs:
-//      int *bucket_nodes: The bucket.
-//      int *relax_nodes: The array to relax.
-void relax_nodes(int *bucket_nodes, int *relax_nodes)
-{
-    int pos = 0;    
-    int item = bucket_nodes[0];
-    
-    // Add buckets nodes to Visited nodes array in order to prevent loops.
-    while (item != -1) {        
-        push_node(visited_nodes, item);
-        pos ++;
-        item = bucket_nodes[pos];    
-    }
-    empty_array(bucket_nodes);
-    
-    struct bucket node_bucket;
-    int node_delta;
-    pos = 0;    
-    item = relax_nodes[0];    
-    while (item != -1) {
-        node_delta = distances[source_node][item] / d_step; // Find node Delta value.
-        node_bucket = retrieve_bucket(node_delta); // Retrieve bucket for that Delta value.    
-        if (!contains(visited_nodes, item)) { // Prevent loops.
-            push_node(node_bucket.nodes, item);
-        }    
-        pos ++;
-        item = relax_nodes[pos];    
-    }
-    pos = 0;    
-    item = updated_nodes[0];    
-    while (item != -1) { 
-        node_delta = distances[source_node][item] / d_step; 
-        node_bucket = retrieve_bucket(node_delta);        
-        push_node(node_bucket.nodes, item); // Insert updated nodes in order to revisit neighbors.
-        pos ++;
-        item = updated_nodes[pos];
-    }
-    empty_array(updated_nodes);    
-}
-
-// This function resets arrays used by the program.
-void reset_node_structures()
+//      int size: Processes size.
+void assign_sources(int size)
 {
-    for (int i = 0; i < nodes_count; i++) {
-        heavy_nodes[i] = -1;
-        light_nodes[i] = -1;
-        visited_nodes[i] = -1;
-        updated_nodes[i] = -1;
-    }
-}
+    double total = 0, done = 0;
+    int p = 0;
 
-// This function allocates memory needed for the Graph matrix.
-void allocate_matrix()
-{
-    matrix = (double**)malloc(sizeof(double*) * nodes_count + sizeof(double) * nodes_count * nodes_count);
-    if (matrix == NULL) {
-        printf("Error: malloc for matrix failed.\n");
+    owners = (index_t*)malloc(nodes_count * sizeof(index_t));
+    if (owners == NULL) {
+        printf("Error: malloc for owners failed.\n");
         exit(1);
     }
-    double *ptr = (double*)(matrix + nodes_count);
-    for(int i = 0; i < nodes_count; i++) {
-        matrix[i] = (ptr + nodes_count * i);
-    }            
-}
-
-// This function initializes the Graph matrix, by reading the input file.
-void initialize_matrix()
-{
-    int i, j;
-    double w;
-
-    matrix = (double**)malloc(sizeof(double*) * nodes_count + sizeof(double) * nodes_count * nodes_count);
-    if (matrix == NULL) {
-        printf("Error: malloc for matrix failed.\n");
-        exit(1);
+    for (index_t i = 0; i < nodes_count; i++) {
+        total += source_cost(i);
     }
-    double *ptr = (double*)(matrix + nodes_count);
-    for(i = 0; i < nodes_count; i++) {
-        matrix[i] = (ptr + nodes_count * i);
-        for (j = 0; j < nodes_count; j++) {
-            matrix[i][j] = -1;            
+    for (index_t i = 0; i < nodes_count; i++) {
+        double cost = source_cost(i);
+        // Next process once the source cost middle passes this process share.
+        while (p < size - 1 && done + cost / 2 > total * (p + 1) / size) {
+            p ++;
         }
-    }            
-    fscanf(fin, "%d", &i);
-    while (i != -1) {
-        fscanf(fin, "%d %lf \n", &j, &w);
-        if (i != j && (matrix[i][j] == -1 || w < matrix[i][j])) {
-            matrix[i][j] = w;
-            matrix[j][i] = w;
-        }                
-        fscanf(fin, "%d", &i);
-    }            
+        owners[i] = p;
+        done += cost;
+    }
 }
 
-// This function initializes all arrays used by the program.
-void initialize_structures()
+// This function initializes all arrays used by the program. Only the
+// distances rows of the process source nodes are allocated.
+// Inputs:
+//      int rank: Process rank.
+//      int size: Processes size.
+void initialize_structures(int rank, int size)
 {
-    buckets = (struct bucket *)malloc(nodes_count * sizeof( struct bucket));
-    if (buckets == NULL) {
-        printf("Error: malloc for buckets failed.\n");
+    if (!dstep_graph_components(&graph)) {
+        printf("Error: malloc for components failed.\n");
         exit(1);
     }
-    distances = (double**)malloc(sizeof(double*) * nodes_count + sizeof(double) * nodes_count * nodes_count);
-    if (distances == NULL) {
-        printf("Error: malloc for distances failed.\n");
+    assign_sources(size);
+    slots = (index_t*)malloc(nodes_count * sizeof(index_t));
+    if (slots == NULL) {
+        printf("Error: malloc for slots failed.\n");
         exit(1);
     }
-    double *ptr = (double*)(distances + nodes_count);
-    heavy_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (heavy_nodes == NULL) {
-        printf("Error: malloc for heavy_nodes failed.\n");
-        exit(1);
+    rows_count = 0;
+    for (index_t i = 0; i < nodes_count; i++) {
+        slots[i] = owners[i] == rank ? rows_count++ : -1;
     }
-    light_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (light_nodes == NULL) {
-        printf("Error: malloc for light_nodes failed.\n");
+    rows = (weight_t*)malloc(sizeof(weight_t) * ((size_t)rows_count * nodes_count + 1));
+    if (rows == NULL) {
+        printf("Error: malloc for rows failed.\n");
         exit(1);
     }
-    visited_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (visited_nodes == NULL) {
-        printf("Error: malloc for visited_nodes failed.\n");
-        exit(1);
+    for (size_t i = 0; i < (size_t)rows_count * nodes_count; i++) {
+        rows[i] = NO_WEIGHT;
     }
-    updated_nodes = (int*)malloc(nodes_count * sizeof(int));
-    if (updated_nodes == NULL) {
-        printf("Error: malloc for updated_nodes failed.\n");
+    if (!dstep_context_initialize(&context, &graph, d_step) || !dstep_context_strategy(&context, strategy, rho)) {
+        printf("Error: malloc for solver context failed.\n");
         exit(1);
     }
-    for (int i = 0; i < nodes_count; i++) {
-        buckets[i].delta = (int*)malloc(sizeof(int));
-        if (buckets[i].delta == NULL) {
-            printf("Error: malloc for buckets[%d].delta failed.\n", i);
-            exit(1);
-        }
-        buckets[i].delta[0] = -1;
-        buckets[i].nodes = (int*)malloc(nodes_count * sizeof(int));
-        if (buckets[i].nodes == NULL) {
-            printf("Error: malloc for buckets[%d].nodes failed.\n", i);
-            exit(1);
-        }
-        distances[i] = (ptr + nodes_count * i);
-        for (int j = 0; j < nodes_count; j++) {
-            buckets[i].nodes[j] = -1;
-            distances[i][j] = -1;            
-        }        
-        heavy_nodes[i] = -1;
-        light_nodes[i] = -1;
-        visited_nodes[i] = -1;
-        updated_nodes[i] = -1;        
-    }
 }
 
 // This function frees allocated memory of all arrays used by the program.
 void free_structures()
 {
-    free(matrix);
-    free(buckets);
-    free(distances);
-    free(heavy_nodes);
-    free(light_nodes);
-    free(visited_nodes);
-    free(updated_nodes);
-}
-
-// This function implements the D-Stepping algorithm and finds 
-// the shortest path distances from a source node to all other nodes.
-void d_step_algorithm()
-{
-    int i, j;
-
-    // First bucket to use will contain the source node and will
-    // have Delta value 0.
-    struct bucket current_bucket = buckets[0];
-    current_bucket.delta[0] = 0;
-    push_node(current_bucket.nodes, source_node);
-
-    // While Buckets are not empty...
-    while (current_bucket.nodes[0] != -1) {                
-        i = 0;
-        while (current_bucket.nodes[i] != -1) {    // For each bucket node...        
-            for (j = 0; j < nodes_count; j++) { // For each neighbor...
-                if (matrix[current_bucket.nodes[i]][j] != -1 && j != source_node) {
-                    // Retrieve neighbor distance.
-                    double temp_distance = matrix[current_bucket.nodes[i]][j];
-                    // Insert in appropriate heavy-light node array.
-                    if (temp_distance > d_step) {
-                        push_node(heavy_nodes, j);
-                    } else {
-                        push_node(light_nodes, j);
-                    }
-                    // Add path-so-far distance for that node.
-                    if (distances[source_node][current_bucket.nodes[i]] != -1) {
-                        temp_distance += distances[source_node][current_bucket.nodes[i]];
-                    }
-                    // If the distance found is shorter that the saved one, update Distances array.                
-                    if (distances[source_node][j] == -1 || temp_distance < distances[source_node][j]) {
-                        distances[source_node][j] = temp_distance;
-                        push_node(updated_nodes, j); // Insert node to Updated nodes array.
-                    }            
-                }                    
-            }
-            i ++;    
-        }
-        if (light_nodes[0] != -1) {
-            relax_nodes(current_bucket.nodes, light_nodes); // Relax Light nodes first.
-            empty_array(light_nodes);            
-        } else {
-            relax_nodes(current_bucket.nodes, heavy_nodes); // Relax Heavy nodes no light nodes exists.
-            empty_array(heavy_nodes);            
-        }
-
-        current_bucket = find_next_bucket(); // Retrieve next bucket to process.
-    }
+    dstep_graph_free(&graph);
+    dstep_context_free(&context);
+    free(owners);
+    free(slots);
+    free(rows);
+    free(completed);
 }
 
 // Auxiliary function that displays a message in case of wrong input parameters.
@@ -362,11 +161,81 @@ void d_step_algorithm()
 void syntax_message(char *compiled_name)
 {
     printf("Correct syntax:\n");
-    printf("%s <d_step> <input-file> <output-file>\n", compiled_name);
+    printf("%s <d_step> <input-file> <output-file> [options]\n", compiled_name);
     printf("where: \n");
     printf("<d_step> is the desired D positive double that will be used by the algorithm.\n");
     printf("<input-file> is the file containing a generated graph by RandomGraph that the algorithm will use.\n");
     printf("<output-file> is the file shortest path distances for each node will be written.\n");
+    printf("[options] are:\n");
+    printf("--checkpoint <file> appends rows of completed sources to binary checkpoint files, <file>.<rank> per process.\n");
+    printf("--checkpoint-interval <seconds> is the time between checkpoint files syncs to disk.\n");
+    printf("--resume skips sources completed in the checkpoint files, reading their rows back.\n");
+    printf("--strategy <fixed|adaptive|radius> selects the buckets scanned per phase.\n");
+    printf("--rho <k> uses each node k-th lightest edge as its radius, with the radius strategy.\n");
+    printf("--writers <count> formats the output file in parallel threads of P0, one per online processor by default.\n");
+}
+
+// This function reads the optional run-time parameters, following the
+// mandatory ones. Every process reads them, as they open no files.
+// Inputs:
+//      int argc: The run-time parameters count.
+//      char **argv: The run-time parameters.
+// Output:
+//      1 --> Options read succussfully.
+//      0 --> Something went wrong.
+int read_options(int argc, char **argv)
+{
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+            continue;
+        }
+        if (i + 1 == argc) {
+            printf("Option %s value missing.\n", argv[i]);
+            return 0;
+        }
+        if (strcmp(argv[i], "--checkpoint") == 0) {
+            i++;
+            checkpoint_filename = argv[i];
+        } else if (strcmp(argv[i], "--checkpoint-interval") == 0) {
+            i++;
+            checkpoint_interval = atof(argv[i]);
+        } else if (strcmp(argv[i], "--strategy") == 0) {
+            i++;
+            if (strcmp(argv[i], "fixed") == 0) {
+                strategy = DSTEP_STRATEGY_FIXED;
+            } else if (strcmp(argv[i], "adaptive") == 0) {
+                strategy = DSTEP_STRATEGY_ADAPTIVE;
+            } else if (strcmp(argv[i], "radius") == 0) {
+                strategy = DSTEP_STRATEGY_RADIUS;
+            } else {
+                printf("Unknown bucket strategy %s.\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--rho") == 0) {
+            i++;
+            rho = atol(argv[i]);
+            if (rho <= 0) {
+                printf("Unable to process rho.\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--writers") == 0) {
+            i++;
+            writers_count = atol(argv[i]);
+            if (writers_count <= 0) {
+                printf("Unable to process writers count.\n");
+                return 0;
+            }
+        } else {
+            printf("Unknown option %s.\n", argv[i]);
+            return 0;
+        }
+    }
+    if (resume && checkpoint_filename == NULL) {
+        printf("Resuming requires a checkpoint file.\n");
+        return 0;
+    }
+    return 1;
 }
 
 // This function checks run-time parameters validity and
@@ -421,158 +290,329 @@ int read_parameters(char **argv)
     return 1;
 }
 
-// This function writes the found distances matrix to the output file.
-// First line contains the nodes count.
-// Last line contains -1 as EOF char.
+// This function broadcasts a large indexes buffer from P0 to rest processes.
+// MPI counts are int, so the buffer is transferred in MPI_CHUNK sized pieces.
+// Inputs:
+//      index_t *buffer: The buffer.
+//      size_t count: Buffer elements count.
+void mpi_bcast_indexes(index_t *buffer, size_t count)
+{
+    for (size_t offset = 0; offset < count; offset += MPI_CHUNK) {
+        size_t chunk = (count - offset < MPI_CHUNK) ? count - offset : MPI_CHUNK;
+        MPI_Bcast(buffer + offset, (int)chunk, MPI_INDEX, 0, MPI_COMM_WORLD);
+    }
+}
+
+// This function broadcasts a large weights buffer from P0 to rest processes.
+// MPI counts are int, so the buffer is transferred in MPI_CHUNK sized pieces.
+// Inputs:
+//      weight_t *buffer: The buffer.
+//      size_t count: Buffer elements count.
+void mpi_bcast_weights(weight_t *buffer, size_t count)
+{
+    for (size_t offset = 0; offset < count; offset += MPI_CHUNK) {
+        size_t chunk = (count - offset < MPI_CHUNK) ? count - offset : MPI_CHUNK;
+        MPI_Bcast(buffer + offset, (int)chunk, MPI_WEIGHT, 0, MPI_COMM_WORLD);
+    }
+}
+
+// This function broadcasts the Graph read by P0, and the D value, to rest
+// processes. Compressed rows hold only the edges, so far less is sent than
+// a nodes matrix.
 // Inputs:
-//      double **mpi_distances: Calculated distances.
-//      double **mpi_remainder_distances: Calculated distances of remaining nodes(uneven distribution).
-//      int remainder: Count of remaining nodes(uneven distribution).
-void write_distances_to_file(double **mpi_distances, double **mpi_remainder_distances, int remainder)
+//      int rank: Process rank.
+void mpi_bcast_graph(int rank)
 {
-    int i,j;
-    int finish = nodes_count-remainder;
-    fprintf(fout, "%d\n", nodes_count);
-    for (i = 0; i < finish; i++) {
-        for (j = 0; j < nodes_count; j++) {
-            fprintf(fout, "%lf ", mpi_distances[i][j]);        
+    index_t edges = rank == 0 ? graph.offsets[nodes_count] : 0;
+
+    MPI_Bcast(&nodes_count, 1, MPI_INDEX, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&edges, 1, MPI_INDEX, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&d_step, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) {
+        graph.nodes_count = nodes_count;
+        graph.offsets = (index_t*)malloc((nodes_count + 1) * sizeof(index_t));
+        graph.targets = (index_t*)malloc((edges > 0 ? edges : 1) * sizeof(index_t));
+        graph.weights = (weight_t*)malloc((edges > 0 ? edges : 1) * sizeof(weight_t));
+        if (graph.offsets == NULL || graph.targets == NULL || graph.weights == NULL) {
+            printf("Error: malloc for graph failed.\n");
+            exit(1);
         }
-        fprintf(fout, "\n");
     }
-    if (remainder > 0) {
-        // Remainders distance matrix is in reverse (P0 got line n, P1 got line n-1, etc.).
-        for (i = remainder-1; i > -1; i--) {
-            for (j = 0; j < nodes_count; j++) {
-                fprintf(fout, "%lf ", mpi_remainder_distances[i][j]);        
-            }
-            fprintf(fout, "\n");
+    mpi_bcast_indexes(graph.offsets, (size_t)nodes_count + 1);
+    mpi_bcast_indexes(graph.targets, (size_t)edges);
+    mpi_bcast_weights(graph.weights, (size_t)edges);
+    mpi_bcast_weights(&graph.max_weight, 1);
+}
+
+// This function sends a large weights buffer to a process, in MPI_CHUNK sized pieces.
+// Inputs:
+//      weight_t *buffer: The buffer.
+//      size_t count: Buffer elements count.
+//      int dest: Receiving process rank.
+void mpi_send_weights(weight_t *buffer, size_t count, int dest)
+{
+    for (size_t offset = 0; offset < count; offset += MPI_CHUNK) {
+        size_t chunk = (count - offset < MPI_CHUNK) ? count - offset : MPI_CHUNK;
+        MPI_Send(buffer + offset, (int)chunk, MPI_WEIGHT, dest, 0, MPI_COMM_WORLD);
+    }
+}
+
+// This function receives a large weights buffer from a process, in MPI_CHUNK sized pieces.
+// Inputs:
+//      weight_t *buffer: The buffer.
+//      size_t count: Buffer elements count.
+//      int source: Sending process rank.
+void mpi_recv_weights(weight_t *buffer, size_t count, int source)
+{
+    for (size_t offset = 0; offset < count; offset += MPI_CHUNK) {
+        size_t chunk = (count - offset < MPI_CHUNK) ? count - offset : MPI_CHUNK;
+        MPI_Recv(buffer + offset, (int)chunk, MPI_WEIGHT, source, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+}
+
+// This function formats a row of a run of distances rows received by P0.
+// Inputs:
+//      struct dstep_text *text: The text buffer.
+//      index_t i: The row, in the run.
+//      void *data: The run rows.
+void format_run_line(struct dstep_text *text, index_t i, void *data)
+{
+    weight_t *row = (weight_t*)data + (size_t)i * nodes_count;
+    for (index_t j = 0; j < nodes_count; j++) {
+        dstep_text_append_distance(text, row[j]);
+    }
+    dstep_text_append_char(text, '\n');
+}
+
+// This function returns the distances row of a source node found by the process.
+// Inputs:
+//      index_t source: The source node, found by the process.
+// Output:
+//      weight_t * --> The distances row.
+weight_t *source_row(index_t source)
+{
+    return rows + (size_t)slots[source] * nodes_count;
+}
+
+// This function returns the length of the run of consecutive rows starting
+// at a source node, found by the same process and sent by a single message.
+// Inputs:
+//      index_t first: The first source node of the run.
+// Output:
+//      index_t --> The run rows count.
+index_t run_length(index_t first)
+{
+    index_t limit = RUN_SIZE / (sizeof(weight_t) * nodes_count);
+    index_t length = 1;
+    while (first + length < nodes_count && owners[first + length] == owners[first] && length < limit) {
+        length ++;
+    }
+    return length;
+}
+
+// This function sends the distances rows found by the process to P0, by runs
+// of consecutive source nodes in ascending order, as P0 receives them.
+// Inputs:
+//      int rank: Process rank, not 0.
+void send_rows(int rank)
+{
+    for (index_t first = 0; first < nodes_count; first += run_length(first)) {
+        if (owners[first] == rank) {
+            mpi_send_weights(source_row(first), (size_t)run_length(first) * nodes_count, 0);
         }
     }
-    fprintf(fout, "-1");
 }
 
-// This function handles remaining nodes(unven distribution).
-// P0 collects remaining distances finalizes program by
-// writing all distances to the output file.
+// This function writes the found distances matrix to the output file,
+// receiving rows found by other processes run by run, so P0 never holds
+// more than its own rows and one run. Each run lines are formatted in
+// parallel by the library text writers.
+// First line contains the nodes count.
+// Last line contains -1 as EOF char.
+void write_distances_to_file()
+{
+    index_t limit = RUN_SIZE / (sizeof(weight_t) * nodes_count);
+    struct dstep_text text = { NULL, 0, 0, 0 };
+    weight_t *received = (weight_t*)malloc(sizeof(weight_t) * (size_t)(limit > 0 ? limit : 1) * nodes_count);
+    if (received == NULL) {
+        printf("Error: malloc for received rows failed.\n");
+        exit(1);
+    }
+    // Lines are written past the file stream, so its pending output goes first.
+    fflush(fout);
+    dstep_text_append_node(&text, nodes_count);
+    dstep_text_append_char(&text, '\n');
+    int done = dstep_text_write(&text, fileno(fout));
+    for (index_t first = 0; done && first < nodes_count; first += run_length(first)) {
+        index_t length = run_length(first);
+        weight_t *run = received;
+        if (owners[first] == 0) {
+            run = source_row(first);
+        } else {
+            mpi_recv_weights(received, (size_t)length * nodes_count, (int)owners[first]);
+        }
+        done = dstep_write_lines(fileno(fout), length, writers_count, (size_t)nodes_count * 10 + 1, format_run_line, run);
+    }
+    dstep_text_append_char(&text, '-');
+    dstep_text_append_char(&text, '1');
+    done = done && dstep_text_write(&text, fileno(fout));
+    dstep_text_free(&text);
+    free(received);
+    if (!done) {
+        printf("Error: cannot format or write output file.\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+}
+
+// This function opens the process checkpoint file. When resuming, rows of
+// completed source nodes are read back and a truncated last record is
+// discarded, so new records follow the last complete one. Rows of source
+// nodes now found by other processes are skipped. Otherwise, a new file
+// is started.
 // Inputs:
-//      double **mpi_distances: Calculated distances.
 //      int rank: Process rank.
-//      int remainder: Count of remaining nodes(uneven distribution).
-void handle_remainders_and_finalize(double **mpi_distances, int rank, int remainder)
+void open_checkpoint(int rank)
 {
-    int i;
-    double** mpi_remainder_distances;
-    if (remainder > 0) {
-        // Process 0 will collect all calculated distances by the assigned processes.        
-        if (rank == 0) {
-            mpi_remainder_distances = (double**)malloc(sizeof(double*) * remainder + sizeof(double) * remainder * nodes_count);
-            if (mpi_remainder_distances == NULL) {
-                printf("Error: malloc for mpi_remainder_distances failed.\n");
-                exit(1);
-            }
-            double *mpi_remainder_distances_ptr = (double*)(mpi_remainder_distances + remainder);
-            for (i = 0; i < remainder; i++) {
-                mpi_remainder_distances[i] = (mpi_remainder_distances_ptr + nodes_count * i);        
-            }
-            for (i = 0; i < nodes_count; i++) {
-                mpi_remainder_distances[0][i] = distances[nodes_count-1][i];    
-            }
-            for (i = 1; i < remainder; i++) {
-                MPI_Recv(mpi_remainder_distances[i], nodes_count, MPI_DOUBLE, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            }
-        } else {
-            double *mpi_process_remainder_distances = (double*)malloc(nodes_count * sizeof(double));
-            if (mpi_process_remainder_distances == NULL) {
-                printf("Error: malloc for mpi_process_remainder_distances failed.\n");
-                exit(1);
-            }
-            for (i = 0; i < nodes_count; i++) {
-                mpi_process_remainder_distances[i] = distances[nodes_count-rank-1][i];        
+    char filename[4096], magic[8];
+    uint32_t sizes[2] = { sizeof(index_t), sizeof(weight_t) };
+    uint32_t file_sizes[2];
+    index_t count, source, resumed = 0;
+    long header = sizeof(magic) + sizeof(sizes) + sizeof(index_t);
+    long record = sizeof(index_t) + sizeof(weight_t) * nodes_count;
+
+    snprintf(filename, sizeof(filename), "%s.%d", checkpoint_filename, rank);
+    completed = (char*)malloc(nodes_count * sizeof(char));
+    weight_t *skipped = (weight_t*)malloc(nodes_count * sizeof(weight_t));
+    if (completed == NULL || skipped == NULL) {
+        printf("Error: malloc for completed failed.\n");
+        exit(1);
+    }
+    for (index_t i = 0; i < nodes_count; i++) {
+        completed[i] = 0;
+    }
+    fcheckpoint = resume ? fopen(filename, "r+b") : NULL;
+    if (fcheckpoint != NULL) {
+        if (fread(magic, sizeof(magic), 1, fcheckpoint) != 1 || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+            || fread(file_sizes, sizeof(file_sizes), 1, fcheckpoint) != 1 || file_sizes[0] != sizes[0] || file_sizes[1] != sizes[1]
+            || fread(&count, sizeof(index_t), 1, fcheckpoint) != 1 || count != nodes_count) {
+            printf("Error: checkpoint file %s doesn't match the Graph or the compiled types.\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        long end = header;
+        while (fread(&source, sizeof(index_t), 1, fcheckpoint) == 1
+            && source >= 0 && source < nodes_count
+            && fread(slots[source] != -1 ? source_row(source) : skipped, sizeof(weight_t), nodes_count, fcheckpoint) == (size_t)nodes_count) {
+            if (slots[source] != -1 && !completed[source]) {
+                completed[source] = 1;
+                resumed ++;
             }
-            MPI_Send(mpi_process_remainder_distances, nodes_count, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
-            free(mpi_process_remainder_distances);
+            end += record;
         }
+        if (fseek(fcheckpoint, end, SEEK_SET) != 0 || ftruncate(fileno(fcheckpoint), end) != 0) {
+            printf("Error: cannot truncate checkpoint file %s.\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        printf("P%d resumed " INDEX_FORMAT " completed sources from checkpoint file %s.\n", rank, resumed, filename);
+    } else {
+        fcheckpoint = fopen(filename, "wb");
+        if (fcheckpoint == NULL) {
+            printf("Error: cannot open checkpoint file %s.\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        fwrite(CHECKPOINT_MAGIC, sizeof(magic), 1, fcheckpoint);
+        fwrite(sizes, sizeof(sizes), 1, fcheckpoint);
+        fwrite(&nodes_count, sizeof(index_t), 1, fcheckpoint);
     }
+    free(skipped);
+    last_checkpoint = MPI_Wtime();
+}
 
-    if (rank == 0) {
-        printf("Algorithm finished!\n");
-        printf("Time spend: %f secs\n", ((float)t2 -t1) / CLOCKS_PER_SEC);
-        printf("Writing distances to output file.\n");
-        write_distances_to_file(mpi_distances, mpi_remainder_distances, remainder);
-        free(mpi_distances);
-        if (remainder > 0) {
-            free(mpi_remainder_distances);
-        }
+// This function syncs the process checkpoint file to disk.
+void sync_checkpoint()
+{
+    fflush(fcheckpoint);
+    fsync(fileno(fcheckpoint));
+    last_checkpoint = MPI_Wtime();
+}
+
+// This function closes the process checkpoint file, syncing all its records.
+void close_checkpoint()
+{
+    if (fcheckpoint == NULL) {
+        return;
+    }
+    sync_checkpoint();
+    fclose(fcheckpoint);
+    fcheckpoint = NULL;
+}
+
+// This function appends the distances row found from the source node to the
+// process checkpoint file, and syncs the file when the checkpoint interval
+// has passed.
+void checkpoint_source()
+{
+    if (fcheckpoint == NULL) {
+        return;
+    }
+    fwrite(&source_node, sizeof(index_t), 1, fcheckpoint);
+    fwrite(source_row(source_node), sizeof(weight_t), nodes_count, fcheckpoint);
+    completed[source_node] = 1;
+    if (MPI_Wtime() - last_checkpoint >= checkpoint_interval) {
+        sync_checkpoint();
     }
-    free_structures();
+}
+
+// This function finds the distances from the source node, unless they
+// were read back from the checkpoint file, and checkpoints them.
+void find_source_distances()
+{
+    if (completed != NULL && completed[source_node]) {
+        return;
+    }
+    dstep_sssp(&context, source_node, source_row(source_node));
+    checkpoint_source();
 }
 
 // This function parallilizes the D-Stepping algorithm using the MPI Standard. 
-// Each process calculate the shortest path distances for nodes count / processes count.
-// If the distribution is un-even, remaining nodes will be assigned to a process in reverse.
+// Each process calculate the shortest path distances for the source nodes
+// assigned to it, then P0 writes all of them to the output file.
 // Inputs:
 //      int rank: Process rank.
 //      int size: Processes size.
 void mpi_d_step(int rank, int size)
 {
-    int i,j;
-    int interval =     nodes_count / size; // Each node will process interval nodes.
-    int remainder = nodes_count % size; // Remaining nodes will be distributed evenly among process.
-    int start = rank * interval;
-    int finish = start + interval;
-    initialize_structures();
+    initialize_structures(rank, size);
+    if (checkpoint_filename != NULL) {
+        open_checkpoint(rank);
+    }
     
     if (rank == 0) {
         t1 = clock();    
     }
     // Retrieve shortest path distances from each process node to all other nodes of the Graph.
-    for (source_node = start; source_node < finish; source_node++) {
-        d_step_algorithm();
-        reset_node_structures();
-    }
-    // Retrieve shortest path for remaining node.
-    if (rank < remainder) {
-        source_node = nodes_count-rank-1; // Assign remaining node.
-        d_step_algorithm();
-        reset_node_structures();
-    }    
+    for (source_node = 0; source_node < nodes_count; source_node++) {
+        if (owners[source_node] == rank) {
+            find_source_distances();
+        }
+    }
     if (rank == 0) {
         t2 = clock();    
     }
+    close_checkpoint();
+    unsigned long long process_phases[2] = { context.phases, context.scans };
+    MPI_Reduce(process_phases, phases, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
-    // Process 0 will collect all calculated distances.
-    double **mpi_process_distances = (double**)malloc(sizeof(double*) * interval + sizeof(double) * interval * nodes_count);
-    if (mpi_process_distances == NULL) {
-        printf("Error: malloc for mpi_process_distances failed.\n");
-        exit(1);
-    }
-    double *mpi_process_distances_ptr = (double*)(mpi_process_distances + interval);
-    for (i = 0; i < interval; i++) {
-        mpi_process_distances[i] = (mpi_process_distances_ptr + nodes_count * i);
-        for (j = 0; j < nodes_count; j++) {
-            mpi_process_distances[i][j] = distances[start + i][j];
-        }        
-    }
-    
-    double **mpi_distances;
+    // Process 0 will collect all calculated distances while writing them.
     if (rank == 0) {
-        mpi_distances = (double**)malloc(sizeof(double*) * (nodes_count-remainder) + sizeof(double) * (nodes_count-remainder) * nodes_count);
-        if (mpi_distances == NULL) {
-            printf("Error: malloc for mpi_distances failed.\n");
-            exit(1);
-        }
-        double* mpi_distances_ptr = (double*)(mpi_distances + (nodes_count-remainder));
-        for (i = 0; i < (nodes_count-remainder); i++) {
-            mpi_distances[i] = (mpi_distances_ptr + nodes_count * i);        
-        }
-
+        printf("Algorithm finished!\n");
+        printf("Time spend: %f secs\n", ((float)t2 -t1) / CLOCKS_PER_SEC);
+        printf("Phases: %llu, node scans: %llu\n", phases[0], phases[1]);
+        printf("Writing distances to output file.\n");
+        write_distances_to_file();
+    } else {
+        send_rows(rank);
     }
-
-    MPI_Gather(*mpi_process_distances, (interval*nodes_count), MPI_DOUBLE, *mpi_distances, (interval*nodes_count), MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    free(mpi_process_distances);    
-    
-    // Handle remaining nodes and finalize program.
-    handle_remainders_and_finalize(mpi_distances, rank, remainder);
+    free_structures();
 }
 
 int main(int argc, char **argv)
@@ -581,6 +621,14 @@ int main(int argc, char **argv)
     MPI_Init(&argc,&argv);
     MPI_Comm_rank(MPI_COMM_WORLD,&rank);
     MPI_Comm_size(MPI_COMM_WORLD,&size);
+    if (!read_options(argc, argv)) {
+        if (rank == 0) {
+            syntax_message(argv[0]);
+            printf("Program terminates.\n");
+        }
+        MPI_Finalize();
+        return -1;
+    }
 
     // P0 will read Graph Matrix from the input file and send it to rest processes.
     // After initializion completes, every process starts calculating distances.
@@ -590,15 +638,18 @@ int main(int argc, char **argv)
             printf("Program terminates.\n");
             MPI_Abort(MPI_COMM_WORLD, -1);
         }
-        fscanf(fin, "%d \n", &nodes_count); // Retrieve Graph nodes count.
+        if (!dstep_graph_read(&graph, fin)) {
+            printf("Error: cannot read Graph from input file.\n");
+            fclose(fin);
+            fclose(fout);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        nodes_count = graph.nodes_count;
         if (nodes_count > 0) {
-            printf("Nodes count: %d\n", nodes_count);
+            printf("Nodes count: " INDEX_FORMAT "\n", nodes_count);
             printf("Algorithm started, please wait...\n");    
-            initialize_matrix();
-            // Broadcast Graph nodes count to rest processes.            
-            MPI_Bcast(&nodes_count, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-            // Broadcast Graph matrix to rest processes.
-            MPI_Bcast(*matrix, (nodes_count*nodes_count), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+            // Broadcast Graph to rest processes.
+            mpi_bcast_graph(rank);
             // Start processing.
             mpi_d_step(rank, size);
             fclose(fin);
@@ -610,11 +661,8 @@ int main(int argc, char **argv)
             MPI_Abort(MPI_COMM_WORLD, -1);
         }
     } else {
-        // Retrieve Graph nodes count in order to allocate memory for retrieving the Graph matrix.
-        MPI_Bcast(&nodes_count, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-        allocate_matrix();
-        // Retrieve Graph matrix by P0.
-        MPI_Bcast(*matrix, (nodes_count*nodes_count), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        // Retrieve Graph by P0.
+        mpi_bcast_graph(rank);
         mpi_d_step(rank, size);
     }        
     MPI_Finalize();